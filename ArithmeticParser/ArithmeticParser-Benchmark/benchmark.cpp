@@ -0,0 +1,447 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// benchmark.cpp : Google Benchmark suite for the parser stages.
+//
+// Every benchmark handles one expression per iteration and takes { terms, depth, mix } arguments:
+//   terms  number of operands in the expression
+//   depth  number of nested parentheses, 0 for a flat expression
+//   mix    operators used between the operands, see OpMix
+// Besides the time per iteration, each run reports time_per_expr (ns/expr), items_per_second (expressions)
+// and bytes_per_second (expression characters).
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "ArithmeticParser.h"
+#include "ExpressionCache.h"
+#include "JitExpression.h"
+#include "ParallelEvaluation.h"
+
+namespace {
+    enum OpMix : int
+    {
+        Additive,       // + and -
+        Multiplicative, // * and /
+        Mixed           // + * - / in turn
+    };
+
+    constexpr const char* opMixName(const int mix) noexcept
+    {
+        switch (mix) {
+        case Additive:
+            return "additive";
+        case Multiplicative:
+            return "multiplicative";
+        default:
+            return "mixed";
+        }
+    }
+
+    char nextOperator(const int mix, const std::size_t index) noexcept
+    {
+        switch (mix) {
+        case Additive:
+            return "+-"[index % 2];
+        case Multiplicative:
+            return "*/"[index % 2];
+        default:
+            return "+*-/"[index % 4];
+        }
+    }
+
+    // value of x in the expressions with a variable, the same as the literal it replaces
+    template<typename T>
+    const T* variableValues() noexcept
+    {
+        static const T x = std::is_floating_point_v<T> ? static_cast<T>(1.5) : static_cast<T>(3);
+        return &x;
+    }
+
+    /*
+    *	operands of * and / cancel out so that long expressions neither overflow nor divide by zero.
+    *	with a variable, x replaces the first operand and the operands of * and /, so that
+    *	constant folding cannot turn the expression into a single literal.
+    */
+    template<typename T>
+    void appendOperand(std::string& expr, const char op, const std::size_t index, const bool variable)
+    {
+        if (variable && (index == 0 || op == '*' || op == '/')) {
+            expr += 'x';
+        }
+        else if (op == '*' || op == '/') {
+            expr += std::is_floating_point_v<T> ? "1.5" : "3";
+        }
+        else {
+            expr += static_cast<char>('1' + index % 9);
+            if constexpr (std::is_floating_point_v<T>) {
+                expr += ".25";
+            }
+        }
+    }
+
+    /*
+    *	flat:    1 + 2 - 3 + 4 ...
+    *	nested:  ((((1 + 2) * 3) - 4) / 3) ...  the first depth operators close a parenthesis each,
+    *	         which keeps depth open parentheses on the operator stack while parsing
+    */
+    template<typename T>
+    std::string makeExpression(const std::size_t terms, const std::size_t depth, const int mix, const bool variable)
+    {
+        std::string expr(depth, '(');
+        appendOperand<T>(expr, '+', 0, variable);
+        for (std::size_t i = 1; i < terms; i++) {
+            const auto op = nextOperator(mix, i - 1);
+            expr += ' ';
+            expr += op;
+            expr += ' ';
+            appendOperand<T>(expr, op, i, variable);
+            if (i <= depth) {
+                expr += ')';
+            }
+        }
+        return expr;
+    }
+
+    // benchmarks of compiled programs use the variable x, parseAndEvaluate only takes literals
+    template<typename T>
+    std::string makeExpression(const benchmark::State& state, const bool variable = false)
+    {
+        return makeExpression<T>(static_cast<std::size_t>(state.range(0)),
+            static_cast<std::size_t>(state.range(1)), static_cast<int>(state.range(2)), variable);
+    }
+
+    // literal scanning on its own, operators and parentheses are skipped
+    template<typename T>
+    class LexingProbe : public Parser::ArithmeticParser<T>
+    {
+    public:
+        static bool lex(std::string_view strExpr, T& last) noexcept
+        {
+            auto iter = strExpr.data();
+            const auto end = iter + strExpr.size();
+            while (iter != end) {
+                if (LexingProbe::isLiteralStart(iter, end)) {
+                    if (LexingProbe::parseLiteral(iter, end, last) != Parser::ErrorCode::None) {
+                        return false;
+                    }
+                }
+                else {
+                    ++iter;
+                }
+            }
+            return true;
+        }
+    };
+
+    void setCounters(benchmark::State& state, const std::string& expr)
+    {
+        const auto iterations = static_cast<int64_t>(state.iterations());
+        state.SetItemsProcessed(iterations);
+        state.SetBytesProcessed(iterations * static_cast<int64_t>(expr.size()));
+        // inverted rate, printed as seconds per expression with an SI prefix (e.g. 42.1ns)
+        state.counters["time_per_expr"] = benchmark::Counter(1.0,
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+        state.SetLabel(opMixName(static_cast<int>(state.range(2))));
+    }
+
+    // short formulas of the kind found in configuration files and rule engines
+    constexpr const char* const corpus[] = {
+        "price * quantity",
+        "price * quantity * (1 - discount)",
+        "total - total * tax",
+        "(revenue - cost) / revenue",
+        "(close - open) / open * 100",
+        "(high + low) / 2",
+        "(a + b + c) / 3",
+        "x / 2 - 1",
+        "a * b + c",
+        "base + rate * hours",
+        "principal * rate / 12",
+        "celsius * 9 / 5 + 32",
+        "(x - mean) / deviation",
+        "0.5 * mass * velocity * velocity",
+        "speed * time + 0.5 * accel * time * time",
+        "width * height * depth",
+        "(x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1)",
+        "offset + scale * (value - minimum) / (maximum - minimum)",
+    };
+
+    // flat expressions of growing length for every operator mix, then nested ones of growing depth
+    void expressionShapes(benchmark::internal::Benchmark* bench)
+    {
+        bench->ArgNames({ "terms", "depth", "mix" });
+        for (const auto mix : { Additive, Multiplicative, Mixed }) {
+            for (const auto terms : { 4, 32, 256 }) {
+                bench->Args({ terms, 0, mix });
+            }
+        }
+        for (const auto depth : { 8, 32, 128 }) {
+            bench->Args({ depth + 1, depth, Mixed });
+        }
+    }
+
+    // flat mixed expressions on pools of growing size
+    void poolSizes(benchmark::internal::Benchmark* bench)
+    {
+        bench->ArgNames({ "terms", "depth", "mix", "threads" })->UseRealTime();
+        for (const auto threads : { 1, 2, 4, 8 }) {
+            for (const auto terms : { 4, 32 }) {
+                bench->Args({ terms, 0, Mixed, threads });
+            }
+        }
+    }
+
+    template<typename T>
+    void BM_Construct(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state);
+        for (auto _ : state) {
+            Parser::ArithmeticParser<T> parser{ expr };
+            benchmark::DoNotOptimize(parser);
+        }
+        setCounters(state, expr);
+    }
+
+    template<typename T>
+    void BM_Lex(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state);
+        T last{};
+        for (auto _ : state) {
+            if (!LexingProbe<T>::lex(expr, last)) {
+                state.SkipWithError("lexing failed");
+                break;
+            }
+            benchmark::DoNotOptimize(last);
+        }
+        setCounters(state, expr);
+    }
+
+    // parsing up to a compiled program, without evaluating it
+    template<typename T>
+    void BM_Parse(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state, true);
+        Parser::ArithmeticParser<T> parser;
+        for (auto _ : state) {
+            auto program = parser.tryCompile(expr);
+            if (!program) {
+                state.SkipWithError(program.message());
+                break;
+            }
+            benchmark::DoNotOptimize(program);
+        }
+        setCounters(state, expr);
+    }
+
+    template<typename T, Parser::Engine engine = Parser::Engine::Stack>
+    void BM_Evaluate(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state, true);
+        const auto compiled = Parser::ArithmeticParser<T>{}.tryCompile(expr);
+        if (!compiled) {
+            state.SkipWithError(compiled.message());
+            return;
+        }
+        auto program = compiled.value();
+        program.setEngine(engine);
+        for (auto _ : state) {
+            const auto result = program.tryEvaluate(variableValues<T>());
+            if (!result) {
+                state.SkipWithError(result.message());
+                break;
+            }
+            benchmark::DoNotOptimize(result);
+        }
+        setCounters(state, expr);
+    }
+
+    /*
+    *	the programs of BM_Evaluate on the stack and register engines, labelled with the dispatch
+    *	compiled in. ArithmeticParserBenchmarkSwitch builds this file with ARITHMETIC_PARSER_COMPUTED_GOTO=0,
+    *	running both executables with --benchmark_filter=BM_Dispatch compares computed goto and switch.
+    */
+    template<typename T, Parser::Engine engine>
+    void BM_Dispatch(benchmark::State& state)
+    {
+        BM_Evaluate<T, engine>(state);
+        state.SetLabel(std::string{ ARITHMETIC_PARSER_COMPUTED_GOTO ? "computed goto, " : "switch, " } +
+            opMixName(static_cast<int>(state.range(2))));
+    }
+
+    // native code of the same program, int and double only
+    template<typename T>
+    void BM_EvaluateJit(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state, true);
+        const Parser::JitExpression<T> program{ Parser::ArithmeticParser<T>{}.compile(expr) };
+        if (!program.native()) {
+            state.SkipWithError("no native code for this program");
+            return;
+        }
+        for (auto _ : state) {
+            const auto result = program.tryEvaluate(variableValues<T>());
+            if (!result) {
+                state.SkipWithError(result.message());
+                break;
+            }
+            benchmark::DoNotOptimize(result);
+        }
+        setCounters(state, expr);
+    }
+
+    /*
+    *	every formula of the corpus once per iteration, variable slot i is set to i + 1.5.
+    *	besides the time, reports the average number of instructions per formula in the
+    *	postfix program (instructions) and in the code of the engine (dispatched).
+    */
+    template<typename T, Parser::Engine engine>
+    void BM_EvaluateCorpus(benchmark::State& state)
+    {
+        std::vector<Parser::CompiledExpression<T>> programs;
+        std::size_t instructions = 0;
+        std::size_t dispatched = 0;
+        Parser::ArithmeticParser<T> parser;
+        for (const auto expr : corpus) {
+            programs.push_back(parser.compile(expr));
+            programs.back().setEngine(engine);
+            instructions += programs.back().size();
+            dispatched += programs.back().bytecodeSize();
+        }
+        std::vector<T> values(16);
+        for (std::size_t i = 0; i < values.size(); i++) {
+            values[i] = static_cast<T>(i) + static_cast<T>(1.5);
+        }
+        for (auto _ : state) {
+            for (const auto& program : programs) {
+                const auto result = program.tryEvaluate(values.data());
+                if (!result) {
+                    state.SkipWithError(result.message());
+                    return;
+                }
+                benchmark::DoNotOptimize(result);
+            }
+        }
+        const auto count = static_cast<double>(programs.size());
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(programs.size()));
+        state.counters["time_per_expr"] = benchmark::Counter(count,
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+        state.counters["instructions"] = static_cast<double>(instructions) / count;
+        state.counters["dispatched"] = static_cast<double>(dispatched) / count;
+    }
+
+    // lookup of an expression which is already in the cache, then evaluation of its program
+    template<typename T>
+    void BM_CacheHit(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state);
+        Parser::ExpressionCache<T> cache;
+        (void)cache.tryGet(expr);
+        for (auto _ : state) {
+            const auto result = cache.tryEvaluate(expr);
+            if (!result) {
+                state.SkipWithError(result.message());
+                break;
+            }
+            benchmark::DoNotOptimize(result);
+        }
+        setCounters(state, expr);
+    }
+
+    // a batch of 4096 copies evaluated on a pool of state.range(3) threads, counters are per expression
+    template<typename T>
+    void BM_EvaluateAll(benchmark::State& state)
+    {
+        constexpr std::size_t const batch = 4096;
+        const auto expr = makeExpression<T>(state);
+        const std::vector<std::string_view> expressions(batch, expr);
+        std::vector<Parser::Result<T>> results;
+        Parser::ThreadPool pool{ static_cast<std::size_t>(state.range(3)) };
+        for (auto _ : state) {
+            Parser::evaluateAll(expressions, results, pool);
+            benchmark::DoNotOptimize(results.data());
+        }
+        if (!results.front()) {
+            state.SkipWithError(results.front().message());
+        }
+        const auto iterations = static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(batch);
+        state.SetItemsProcessed(iterations);
+        state.SetBytesProcessed(iterations * static_cast<int64_t>(expr.size()));
+        state.counters["time_per_expr"] = benchmark::Counter(static_cast<double>(batch),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+        state.SetLabel(opMixName(static_cast<int>(state.range(2))));
+    }
+
+    // the single pass of parseAndEvaluate, what the old BENCHMARK_TEST loop in main.cpp measured
+    template<typename T>
+    void BM_ParseAndEvaluate(benchmark::State& state)
+    {
+        const auto expr = makeExpression<T>(state);
+        Parser::ArithmeticParser<T> parser;
+        for (auto _ : state) {
+            const auto result = parser.tryEvaluate(expr);
+            if (!result) {
+                state.SkipWithError(result.message());
+                break;
+            }
+            benchmark::DoNotOptimize(result);
+        }
+        setCounters(state, expr);
+    }
+}
+
+#define PARSER_BENCHMARK(func)                                                  \
+BENCHMARK_TEMPLATE(func, int)->Apply(expressionShapes);                         \
+BENCHMARK_TEMPLATE(func, float)->Apply(expressionShapes);                       \
+BENCHMARK_TEMPLATE(func, double)->Apply(expressionShapes);                      \
+
+PARSER_BENCHMARK(BM_Construct)
+PARSER_BENCHMARK(BM_Lex)
+PARSER_BENCHMARK(BM_Parse)
+PARSER_BENCHMARK(BM_Evaluate)
+BENCHMARK_TEMPLATE(BM_Evaluate, int, Parser::Engine::Register)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Evaluate, double, Parser::Engine::Register)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Evaluate, int, Parser::Engine::Closure)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Evaluate, double, Parser::Engine::Closure)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Dispatch, int, Parser::Engine::Stack)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Dispatch, double, Parser::Engine::Stack)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Dispatch, int, Parser::Engine::Register)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_Dispatch, double, Parser::Engine::Register)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, float, Parser::Engine::Stack);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, double, Parser::Engine::Stack);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, float, Parser::Engine::Register);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, double, Parser::Engine::Register);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, float, Parser::Engine::Closure);
+BENCHMARK_TEMPLATE(BM_EvaluateCorpus, double, Parser::Engine::Closure);
+BENCHMARK_TEMPLATE(BM_EvaluateJit, int)->Apply(expressionShapes);
+BENCHMARK_TEMPLATE(BM_EvaluateJit, double)->Apply(expressionShapes);
+PARSER_BENCHMARK(BM_ParseAndEvaluate)
+PARSER_BENCHMARK(BM_CacheHit)
+BENCHMARK_TEMPLATE(BM_EvaluateAll, double)->Apply(poolSizes);
+
+BENCHMARK_MAIN();
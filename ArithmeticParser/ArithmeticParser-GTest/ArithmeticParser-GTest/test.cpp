@@ -22,9 +22,63 @@
 
 #include "pch.h"
 #include "../../ArithmeticParser.h"
+#include "../../AsyncEvaluation.h"
+#include "../../ConstantExpression.h"
+#include "../../ExpressionCache.h"
+#include "../../JitExpression.h"
+#include "../../ParallelEvaluation.h"
+#include "../../StreamEvaluation.h"
+#include "../../TieredExpression.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace Parser;
 
+namespace {
+	// number of calls to the global operator new, used to check allocation-free evaluation
+	std::atomic<std::size_t> g_allocations{};
+}
+
+void* operator new(std::size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+// GCC inlines these into callers and pairs the free with the replaced operator new
+// as if it were the builtin one, so it reports a mismatch which cannot happen here
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
 // parse and evulate the given expression
 int EvulateExpression(std::string strExpression)
 {
@@ -37,7 +91,7 @@ TEST(SimpleTestCase, ArithmeticParserTest) {
 	parser1.setExpression("(4 + 5 * (7 - 3)) - 2");
 	EXPECT_EQ(parser1.parseAndEvaluate(), 22);
 	EXPECT_EQ(ArithmeticParserInt{ "4+5+7/2" }.parseAndEvaluate(), 12);
-	EXPECT_THROW(EvulateExpression("10 + 1"), ParserException);
+	EXPECT_EQ(EvulateExpression("10 + 1"), 11);
 	EXPECT_THROW(EvulateExpression("-10"), ParserException);
 }
 
@@ -45,13 +99,1076 @@ TEST(SimpleTestCase2, ArithmeticParserTest) {
 	EXPECT_THROW(EvulateExpression("    "), ParserException);	//nothing to parse
 	EXPECT_EQ(EvulateExpression("4 / 2 + 3 - 5 + 2"), 2);
 	EXPECT_THROW(EvulateExpression("(4 - 1) - 7 / 0"), ParserException);	//cannot divide by zero
-	EXPECT_THROW(EvulateExpression("4 / 2 + 30 - 5 + 2"), ParserException);	//literal is too long
+	EXPECT_EQ(EvulateExpression("4 / 2 + 30 - 5 + 2"), 29);
 	EXPECT_EQ(EvulateExpression("(((5 + 7)))"), 12);
 	EXPECT_EQ(EvulateExpression("(4 / 2) * (4 * 2)"), 16);
 	EXPECT_EQ(EvulateExpression("(( 5 / 1) * (4 - 3))"), 5);
-	EXPECT_THROW(EvulateExpression("( 15 % 3 + ( 9 - 2 )"), ParserException);	// literal is too long or unbalanced parantheses
+	EXPECT_THROW(EvulateExpression("( 15 % 3 + ( 9 - 2 )"), ParserException);	// invalid token or unbalanced parantheses
 	EXPECT_THROW(EvulateExpression("(( 6 + 2 ) - 5 "), ParserException);	// unbalanced parantheses
-	EXPECT_THROW(EvulateExpression("a + b - c * d"), ParserException);	// invalid token
+	EXPECT_THROW(EvulateExpression("a + b - c * d"), ParserException);	// unknown variable
 	EXPECT_THROW(EvulateExpression("/9"), ParserException);	// missing operand
 
-}
\ No newline at end of file
+}
+TEST(CompileTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser{ "(4 + 5 * (7 - 3)) - 2" };
+	const auto program = parser.compile();
+	EXPECT_FALSE(program.empty());
+	for (int i = 0; i < 3; i++) {
+		EXPECT_EQ(program.evaluate(), 22);
+	}
+
+	parser.setExpression("5 /2 + 4 / 0");
+	const auto divByZero = parser.compile();	// division by zero is an evaluation error
+	EXPECT_THROW((void)divByZero.evaluate(), ParserException);
+
+	parser.setExpression("(5 + 2) + (5 - 2");
+	EXPECT_THROW((void)parser.compile(), ParserException);	// unbalanced parantheses
+	EXPECT_THROW((void)CompiledExpression<int>{}.evaluate(), ParserException);	// nothing to evaluate
+}
+
+TEST(LiteralTestCase, ArithmeticParserTest) {
+	EXPECT_EQ(EvulateExpression("123456789 + 1"), 123456790);
+	EXPECT_EQ(EvulateExpression("2147483647"), 2147483647);
+	EXPECT_EQ(EvulateExpression("0000000000000000000000012 * 2"), 24);
+	EXPECT_THROW(EvulateExpression("2147483648"), ParserException);	// literal is too large
+	EXPECT_THROW(EvulateExpression("123456789012345678901234"), ParserException);	// literal is too large
+	EXPECT_THROW(EvulateExpression("3.14"), ParserException);	// invalid token for integers
+
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ "3.14" }.parseAndEvaluate(), 3.14);
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ ".5 + 5." }.parseAndEvaluate(), 5.5);
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ "1.5e3 / 2E-2" }.parseAndEvaluate(), 75000.0);
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ "0.000000000000000000000000000001" }.parseAndEvaluate(), 1e-30);
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ "123456789012345678901234567890" }.parseAndEvaluate(), 1.2345678901234568e29);
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{ "2.2250738585072014e-308" }.parseAndEvaluate(), 2.2250738585072014e-308);
+	EXPECT_FLOAT_EQ(ArithmeticParserFloat{ "0.1 * 3" }.parseAndEvaluate(), 0.1f * 3);
+	EXPECT_THROW((void)ArithmeticParserDouble{ "1e400" }.parseAndEvaluate(), ParserException);	// literal is out of range
+	EXPECT_THROW((void)ArithmeticParserDouble{ "2e" }.parseAndEvaluate(), ParserException);	// invalid token
+}
+
+TEST(StringViewTestCase, ArithmeticParserTest) {
+	const char buffer[] = "12 * 3 + 4;99 / 0";	// two expressions in one buffer, not null-terminated
+	ArithmeticParserInt parser;
+	EXPECT_EQ(parser.parseAndEvaluate(std::string_view{ buffer, 10 }), 40);
+	EXPECT_EQ(parser.parseAndEvaluate(buffer, 10), 40);
+	EXPECT_EQ(parser.compile(std::string_view{ buffer, 10 }).evaluate(), 40);
+	EXPECT_THROW((void)parser.parseAndEvaluate(buffer + 11, 6), ParserException);	// cannot divide by zero
+	EXPECT_STREQ(buffer, "12 * 3 + 4;99 / 0");	// caller's buffer is untouched
+
+	ArithmeticParserInt parser2{ " 1 +\t2\n" };
+	EXPECT_EQ(parser2.parseAndEvaluate(), 3);
+	EXPECT_EQ(parser2.getExpression(), " 1 +\t2\n");
+	EXPECT_THROW((void)parser2.parseAndEvaluate("1 0"), ParserException);	// missing operator
+	EXPECT_THROW((void)parser2.parseAndEvaluate(std::string_view{}), ParserException);	// nothing to parse
+}
+
+TEST(AllocationTestCase, ArithmeticParserTest) {
+	ArithmeticParserDouble doubleParser;
+	const auto program = ArithmeticParserInt{}.compile("(4 + 5 * (7 - 3)) - 2");
+
+	const auto allocations = g_allocations.load();
+	const auto result1 = ArithmeticParserInt{ "5 + 4 * 3 / 2" }.parseAndEvaluate();
+	const auto result2 = ArithmeticParserInt{}.parseAndEvaluate("((((1 + 2) * 3) - 4) / 5) * 67 + 89");
+	const auto result3 = doubleParser.parseAndEvaluate("3.25 * (1.5e2 - 0.5) / 2");
+	const auto result4 = program.evaluate();
+	EXPECT_EQ(g_allocations.load(), allocations);	// no heap allocations for typical expressions
+
+	EXPECT_EQ(result1, 11);
+	EXPECT_EQ(result2, 156);
+	EXPECT_DOUBLE_EQ(result3, 242.9375);
+	EXPECT_EQ(result4, 22);
+
+	// deeper expressions spill to the heap and still evaluate correctly
+	std::string deep;
+	for (int i = 0; i < 100; i++) {
+		deep += "(1 + ";
+	}
+	deep += "1";
+	deep.append(100, ')');
+	EXPECT_EQ(EvulateExpression(deep), 101);
+	EXPECT_EQ(ArithmeticParserInt{ deep }.compile().evaluate(), 101);
+}
+
+TEST(ReuseTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	EXPECT_THROW((void)parser.parseAndEvaluate("(((1 + 2"), ParserException);	// leaves braces behind
+	EXPECT_EQ(parser.parseAndEvaluate("3 * 4"), 12);
+	EXPECT_THROW((void)parser.parseAndEvaluate("(7 + 1) * (2 / 0)"), ParserException);	// leaves values behind
+	EXPECT_EQ(parser.parseAndEvaluate("8 - 3"), 5);
+	EXPECT_THROW((void)parser.compile("(2 * (3 + 4"), ParserException);
+	EXPECT_EQ(parser.compile("2 * (3 + 4)").evaluate(), 14);
+
+	// once the stacks have grown, the same parser does not allocate again
+	std::string deep;
+	for (int i = 0; i < 100; i++) {
+		deep += "(1 + ";
+	}
+	deep += "1";
+	deep.append(100, ')');
+	EXPECT_EQ(parser.parseAndEvaluate(deep), 101);
+
+	const auto allocations = g_allocations.load();
+	const auto result1 = parser.parseAndEvaluate(deep);
+	const auto result2 = parser.parseAndEvaluate("1 + 2");
+	EXPECT_EQ(g_allocations.load(), allocations);
+	EXPECT_EQ(result1, 101);
+	EXPECT_EQ(result2, 3);
+}
+
+TEST(TryEvaluateTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	auto result = parser.tryEvaluate("(4 + 5 * (7 - 3)) - 2");
+	ASSERT_TRUE(result.hasValue());
+	EXPECT_EQ(result.value(), 22);
+
+	result = parser.tryEvaluate("1 + 2 % 3");
+	EXPECT_FALSE(result);
+	EXPECT_EQ(result.error(), ErrorCode::InvalidToken);
+	EXPECT_EQ(result.offset(), 6u);
+	EXPECT_STREQ(result.message(), "Invalid token.");
+	EXPECT_EQ(result.valueOr(-1), -1);
+	EXPECT_THROW((void)result.value(), ParserException);
+
+	EXPECT_EQ(parser.tryEvaluate("(1 + 2").error(), ErrorCode::UnbalancedParentheses);
+	EXPECT_EQ(parser.tryEvaluate("(1 + 2").offset(), 0u);
+	EXPECT_EQ(parser.tryEvaluate("1 + 2)").offset(), 5u);
+	EXPECT_EQ(parser.tryEvaluate("   ").error(), ErrorCode::EmptyExpression);
+	EXPECT_EQ(parser.tryEvaluate("4 - -1").error(), ErrorCode::UnaryMinus);
+	EXPECT_EQ(parser.tryEvaluate("4 * * 1").offset(), 2u);
+	EXPECT_EQ(parser.tryEvaluate("99999999999").error(), ErrorCode::LiteralTooLarge);
+	EXPECT_EQ(parser.tryEvaluate("1 2").error(), ErrorCode::MissingOperator);
+	EXPECT_EQ(parser.tryEvaluate("8 / (2 - 2)").error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(parser.tryEvaluate("8 / (2 - 2)").offset(), 2u);
+
+	// compiled programs report the offset of the failing operator too
+	const auto program = parser.tryCompile("1 + 8 / (2 - 2)");
+	ASSERT_TRUE(program.hasValue());
+	EXPECT_EQ(program.value().tryEvaluate().error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(program.value().tryEvaluate().offset(), 6u);
+	EXPECT_EQ(parser.tryCompile("1 *").error(), ErrorCode::MissingOperand);
+
+	try {
+		(void)parser.parseAndEvaluate("2 * (3 + 4");
+		FAIL();
+	}
+	catch (const ParserException& ex) {
+		EXPECT_EQ(ex.getErrorCode(), ErrorCode::UnbalancedParentheses);
+		EXPECT_EQ(ex.getOffset(), 4u);
+		EXPECT_EQ(ex.getErrorMsg(), "unbalanced parentheses!");
+	}
+}
+
+TEST(VariableTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	const auto program = parser.compile("(a + b - c * d) / a");
+	ASSERT_EQ(program.variableCount(), 4u);
+	EXPECT_EQ(program.variables()[2], "c");
+	EXPECT_EQ(program.variableIndex("d"), 3u);
+	EXPECT_EQ(program.variableIndex("x"), CompiledExpression<int>::npos);
+
+	const int row1[] = { 2, 10, 3, 4 };
+	const int row2[] = { 5, 20, 1, 5 };
+	EXPECT_EQ(program.evaluate(row1), 0);
+	EXPECT_EQ(program.evaluate(row2), 4);
+	const int row3[] = { 0, 1, 1, 1 };
+	EXPECT_EQ(program.tryEvaluate(row3).error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(program.tryEvaluate().error(), ErrorCode::UnknownVariable);	// no values given
+
+	// pre-bound slots follow the caller's layout
+	const auto bound = parser.compile("price * qty_2 + fee", { "fee", "price", "qty_2" });
+	const int values[] = { 7, 3, 4 };
+	EXPECT_EQ(bound.evaluate(values), 19);
+	EXPECT_EQ(parser.tryCompile("price * tax", { "price" }).error(), ErrorCode::UnknownVariable);
+	EXPECT_EQ(parser.tryCompile("price * tax", { "price" }).offset(), 8u);
+	EXPECT_EQ(parser.tryEvaluate("x + 1").error(), ErrorCode::UnknownVariable);
+
+	const auto scaled = ArithmeticParserDouble{}.compile("x * 2.5e1 + y");
+	const double xy[] = { 0.5, 0.25 };
+	EXPECT_DOUBLE_EQ(scaled.evaluate(xy), 12.75);
+	EXPECT_EQ(ArithmeticParserDouble{}.tryCompile("2e + 1").error(), ErrorCode::MissingOperator);
+}
+
+TEST(BatchTestCase, ArithmeticParserTest) {
+	// not a multiple of the block size, so the last block is partial
+	const std::size_t rows = 1000;
+	std::vector<double> a(rows), b(rows), c(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		a[i] = static_cast<double>(i) * 0.5;
+		b[i] = static_cast<double>(i % 7) + 1.0;
+		c[i] = 3.0 - static_cast<double>(i % 5);
+	}
+
+	ArithmeticParserDouble parser;
+	const auto program = parser.compile("(a * b - c) / b + 2 * (4 - 1.5) - a / 2");
+	const double* columns[] = { a.data(), b.data(), c.data() };
+	std::vector<double> out(rows);
+	program.evaluateBatch(columns, rows, out.data());
+	for (std::size_t i = 0; i < rows; i++) {
+		const double row[] = { a[i], b[i], c[i] };
+		ASSERT_DOUBLE_EQ(out[i], program.evaluate(row)) << "row " << i;
+	}
+
+	// a literal-only program fills every row
+	std::vector<double> constant(10);
+	parser.compile("1.5 * 4").evaluateBatch(nullptr, constant.size(), constant.data());
+	EXPECT_EQ(constant, std::vector<double>(10, 6.0));
+
+	// integers, including the scalar division loop
+	std::vector<int> x(rows), y(rows), result(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		x[i] = static_cast<int>(i) - 300;
+		y[i] = static_cast<int>(i % 9) + 1;
+	}
+	const auto intProgram = ArithmeticParserInt{}.compile("x * y - 100 / y + x");
+	const int* intColumns[] = { x.data(), y.data() };
+	intProgram.evaluateBatch(intColumns, rows, result.data());
+	for (std::size_t i = 0; i < rows; i++) {
+		const int row[] = { x[i], y[i] };
+		ASSERT_EQ(result[i], intProgram.evaluate(row)) << "row " << i;
+	}
+
+	std::vector<float> f(17, 2.0f), fout(17);
+	const float* floatColumns[] = { f.data() };
+	ArithmeticParserFloat{}.compile("f * f + 0.5").evaluateBatch(floatColumns, f.size(), fout.data());
+	EXPECT_EQ(fout, std::vector<float>(17, 4.5f));
+
+	// any zero divisor fails the whole batch
+	y[777] = 0;
+	try {
+		intProgram.evaluateBatch(intColumns, rows, result.data());
+		FAIL();
+	}
+	catch (const ParserException& ex) {
+		EXPECT_EQ(ex.getErrorCode(), ErrorCode::DivisionByZero);
+		EXPECT_EQ(ex.getOffset(), 12u);
+	}
+}
+
+TEST(ThreadTestCase, ArithmeticParserTest) {
+	const auto program = ArithmeticParserInt{}.compile("x * 3 + y", { "x", "y" });	// shared by all threads through a const reference
+
+	const ArithmeticParserInt prototype{ "1 + 2" };
+	std::vector<ArithmeticParserInt> parsers(4, prototype);	// one parser per thread
+	std::vector<int> failures(parsers.size());
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < parsers.size(); t++) {
+		threads.emplace_back([&, t]() {
+			EvaluationContext<int> context;
+			for (int i = 0; i < 20000; i++) {
+				const int values[] = { i, static_cast<int>(t) };
+				if (program.evaluate(values, context) != i * 3 + static_cast<int>(t) ||
+					program.evaluate(values) != i * 3 + static_cast<int>(t) ||
+					parsers[t].parseAndEvaluate() != 3) {
+					failures[t]++;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(failures, std::vector<int>(parsers.size(), 0));
+	EXPECT_EQ(parsers[0].getExpression(), "1 + 2");
+}
+
+TEST(ConstantFoldingTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	const auto constant = parser.compile("(4 + 5 * (7 - 3)) - 2");
+	EXPECT_EQ(constant.size(), 1u);	// a single literal
+	EXPECT_EQ(constant.evaluate(), 22);
+
+	const auto partial = parser.compile("(4 * 3) / 2 + x");
+	EXPECT_EQ(partial.size(), 3u);	// 6 x +
+	const int values[] = { 1 };
+	EXPECT_EQ(partial.evaluate(values), 7);
+	EXPECT_EQ(parser.compile("x + 1 + 2").size(), 5u);	// not reassociated
+
+	// division by zero is not folded, it fails on evaluation at the same position as before
+	const auto divByZero = parser.compile("5 /2 + 4 / 0");
+	const auto result = divByZero.tryEvaluate();
+	const auto direct = parser.tryEvaluate("5 /2 + 4 / 0");
+	EXPECT_EQ(result.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(result.offset(), direct.offset());
+	EXPECT_EQ(parser.compile("(2 - 2) * (1 / (3 - 3))").tryEvaluate().error(), ErrorCode::DivisionByZero);
+
+	EXPECT_EQ(ArithmeticParserInt{}.compile("7 / 2 * 2").evaluate(), 6);	// integer division as in callOperator
+	EXPECT_DOUBLE_EQ(ArithmeticParserDouble{}.compile("0.1 + 0.2").evaluate(), 0.1 + 0.2);
+}
+
+TEST(CommonSubexpressionTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	const auto program = parser.compile("(a*b+c) * (a*b+c) - (a*b+c)");
+	EXPECT_EQ(program.size(), 10u);	// a b * c + store load * load -, instead of 15 instructions
+	const int values[] = { 2, 3, 4 };
+	EXPECT_EQ(program.evaluate(values), 90);
+
+	// the inner a * b is shared by both, the outer one only once
+	const auto nested = parser.compile("(a * b) / (a * b + (a * b) * 2) + (a * b + (a * b) * 2)");
+	EXPECT_EQ(nested.evaluate(values), 18);
+	EXPECT_LT(nested.size(), 19u);
+
+	// batch evaluation uses the same temporaries
+	std::vector<int> a(1000), b(1000), c(1000), out(1000);
+	for (int i = 0; i < 1000; i++) {
+		a[i] = i % 13;
+		b[i] = i % 7 - 3;
+		c[i] = i;
+	}
+	const int* columns[] = { a.data(), b.data(), c.data() };
+	program.evaluateBatch(columns, out.size(), out.data());
+	for (int i = 0; i < 1000; i++) {
+		const auto shared = a[i] * b[i] + c[i];
+		EXPECT_EQ(out[i], shared * shared - shared);
+	}
+
+	// the first error is still reported at the first occurrence
+	const auto divByZero = parser.compile("x / (y - y) + x / (y - y)");
+	const int zero[] = { 1, 2 };
+	const auto result = divByZero.tryEvaluate(zero);
+	EXPECT_EQ(result.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(result.offset(), 2u);
+
+	// literals are only shared when they are the same value, -0.0 is not 0.0
+	const auto zeros = ArithmeticParserDouble{}.compile("(x * ((0 - 1) * 0)) * (x * 0)");
+	const double one[] = { 1.0 };
+	EXPECT_TRUE(std::signbit(zeros.evaluate(one)));	// -0.0 * 0.0
+}
+
+TEST(SuperinstructionTestCase, ArithmeticParserTest) {
+	ArithmeticParserDouble parser;
+	const double values[] = { 6.0, 4.0, 2.5 };
+
+	// x / 2 - 1 runs as load, divide by literal, subtract literal
+	const auto halved = parser.compile("x / 2 - 1");
+	EXPECT_EQ(halved.size(), 5u);
+	EXPECT_EQ(halved.bytecodeSize(), 3u);
+	EXPECT_EQ(halved.evaluate(values), 2.0);
+
+	// a * b + c runs as load, multiply by variable, add variable
+	const auto chain = parser.compile("a * b + c");
+	EXPECT_EQ(chain.bytecodeSize(), 3u);
+	EXPECT_EQ(chain.evaluate(values), 26.5);
+
+	// the product of a + (b - 1) * (c + 2) is added by one multiply-add
+	const auto multiplyAdd = parser.compile("a + (b - 1) * (c + 2)");
+	EXPECT_EQ(multiplyAdd.bytecodeSize(), 6u);
+	EXPECT_EQ(multiplyAdd.evaluate(values), 19.5);
+
+	// every engine agrees with the single pass evaluation
+	const char* expressions[] = { "a - b * c", "a * 3 + b / c", "(a + b) * (a - b) / c", "a / b / c - 2 * a",
+		"3 - a + b * c * 0.5", "(a * b + c) * (a * b + c) - (a * b + c)" };
+	for (const auto expr : expressions) {
+		const auto program = parser.compile(expr);
+		EXPECT_LE(program.bytecodeSize(), program.size());
+		std::string literal;
+		for (const char* ch = expr; *ch != '\0'; ch++) {
+			literal += *ch == 'a' ? "6" : *ch == 'b' ? "4" : *ch == 'c' ? "2.5" : std::string(1, *ch);
+		}
+		EXPECT_EQ(program.evaluate(values), parser.parseAndEvaluate(literal)) << expr;
+	}
+
+	// a division by a zero literal or a zero variable keeps its error and offset
+	const auto byZero = ArithmeticParserInt{}.compile("x / 0 + 1");
+	const int zero[] = { 0 };
+	EXPECT_EQ(byZero.tryEvaluate(zero).error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(byZero.tryEvaluate(zero).offset(), 2u);
+	const auto byVariable = ArithmeticParserInt{}.compile("1 + 2 / x");
+	EXPECT_EQ(byVariable.tryEvaluate(zero).error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(byVariable.tryEvaluate(zero).offset(), 6u);
+}
+
+TEST(RegisterEngineTestCase, ArithmeticParserTest) {
+	ArithmeticParserDouble parser;
+	const double values[] = { 6.0, 4.0, 2.5 };
+
+	// a * b + c is two three-address instructions, the variables are read in place
+	auto chain = parser.compile("a * b + c");
+	EXPECT_EQ(chain.engine(), Engine::Stack);
+	chain.setEngine(Engine::Register);
+	EXPECT_EQ(chain.engine(), Engine::Register);
+	EXPECT_EQ(chain.bytecodeSize(), 2u);
+	EXPECT_EQ(chain.evaluate(values), 26.5);
+
+	// both engines give the same results, with and without shared subexpressions
+	const char* expressions[] = { "x", "7", "a / 2 - 1", "a - b * c", "(a + b) * (a - b) / c", "3 - a + b * c * 0.5",
+		"(a * b + c) * (a * b + c) - (a * b + c)", "(a * b) / (a * b + (a * b) * 2) + (a * b + (a * b) * 2)",
+		"c / (c * (b - a))", "b - (a / c) * (a / c)" };
+	for (const auto expr : expressions) {
+		const auto stack = parser.compile(expr);
+		auto registers = stack;
+		registers.setEngine(Engine::Register);
+		EXPECT_LE(registers.bytecodeSize(), stack.bytecodeSize()) << expr;
+		EXPECT_EQ(registers.evaluate(values), stack.evaluate(values)) << expr;
+	}
+
+	// errors keep their offsets
+	auto byZero = ArithmeticParserInt{}.compile("1 + x / (y - y)");
+	byZero.setEngine(Engine::Register);
+	const int zero[] = { 1, 2 };
+	const auto result = byZero.tryEvaluate(zero);
+	EXPECT_EQ(result.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(result.offset(), 6u);
+	EXPECT_EQ(byZero.tryEvaluate(nullptr).error(), ErrorCode::UnknownVariable);
+
+	CompiledExpression<int> empty;
+	empty.setEngine(Engine::Register);
+	EXPECT_EQ(empty.tryEvaluate().error(), ErrorCode::EmptyExpression);
+}
+
+TEST(ClosureEngineTestCase, ArithmeticParserTest) {
+	ArithmeticParserDouble parser;
+	const double values[] = { 6.0, 4.0, 2.5 };
+
+	// a node per operator, the literal and the variables are operands of the nodes
+	auto chain = parser.compile("a * b + 2");
+	chain.setEngine(Engine::Closure);
+	EXPECT_EQ(chain.engine(), Engine::Closure);
+	EXPECT_EQ(chain.bytecodeSize(), 2u);
+	EXPECT_EQ(chain.evaluate(values), 26.0);
+
+	// all engines agree, shared subexpressions are computed once and reloaded
+	const char* expressions[] = { "x", "7", "a / 2 - 1", "a - b * c", "(a + b) * (a - b) / c", "3 - a + b * c * 0.5",
+		"(a * b + c) * (a * b + c) - (a * b + c)", "(a * b) / (a * b + (a * b) * 2) + (a * b + (a * b) * 2)" };
+	for (const auto expr : expressions) {
+		const auto stack = parser.compile(expr);
+		auto closures = stack;
+		closures.setEngine(Engine::Closure);
+		auto registers = stack;
+		registers.setEngine(Engine::Register);
+		EXPECT_EQ(closures.evaluate(values), stack.evaluate(values)) << expr;
+		EXPECT_EQ(closures.evaluate(values), registers.evaluate(values)) << expr;
+	}
+
+	// the first division by zero in evaluation order is reported
+	auto byZero = ArithmeticParserInt{}.compile("x / (y - y) + 1 / (y - y)");
+	byZero.setEngine(Engine::Closure);
+	const int zero[] = { 1, 2 };
+	const auto result = byZero.tryEvaluate(zero);
+	EXPECT_EQ(result.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(result.offset(), 2u);
+	EXPECT_THROW((void)byZero.evaluate(zero), ParserException);
+
+	// a long chain is one loop, subtrees nested deeper than the recursion limit stay on the stack engine
+	std::string flat = "x";
+	std::string nested = "x";
+	for (int i = 0; i < ARITHMETIC_PARSER_CLOSURE_DEPTH + 10; i++) {
+		flat += " + 1";
+		nested = "x - (" + nested + ")";
+	}
+	auto sum = ArithmeticParserInt{}.compile(flat);
+	sum.setEngine(Engine::Closure);
+	EXPECT_EQ(sum.engine(), Engine::Closure);
+	EXPECT_EQ(sum.evaluate(zero), ARITHMETIC_PARSER_CLOSURE_DEPTH + 11);
+	auto tall = ArithmeticParserInt{}.compile(nested);
+	tall.setEngine(Engine::Closure);
+	EXPECT_EQ(tall.engine(), Engine::Stack);
+	EXPECT_EQ(tall.evaluate(zero), (ARITHMETIC_PARSER_CLOSURE_DEPTH + 10) % 2 == 0 ? 1 : 0);
+}
+
+TEST(NodeArenaTestCase, ArithmeticParserTest) {
+	EXPECT_LT(sizeof(NodeArena<double>::Node), 16u);
+
+	// (a * 2) + (a * 2), the shared subtree is stored once and operands come first
+	NodeArena<double> arena;
+	const auto a = arena.variable(0);
+	const auto two = arena.literal(2.0);
+	const auto product = arena.operation(OpCode::Mul, a, two);
+	EXPECT_EQ(arena.operation(OpCode::Mul, arena.variable(0), arena.literal(2.0)), product);
+	const auto sum = arena.operation(OpCode::Add, product, product);
+	EXPECT_EQ(arena.size(), 4u);
+	EXPECT_LT(product, sum);
+	EXPECT_EQ(arena[sum].lhs, product);
+	EXPECT_EQ(arena.value(arena[two]), 2.0);
+	EXPECT_NE(arena.literal(-0.0), arena.literal(0.0));
+
+	// enough nodes to grow the table, all of them are still found
+	for (std::uint32_t i = 0; i < 10000; i++) {
+		(void)arena.operation(OpCode::Add, arena.literal(static_cast<double>(i)), a);
+	}
+	const auto size = arena.size();
+	for (std::uint32_t i = 0; i < 10000; i += 7) {
+		(void)arena.operation(OpCode::Add, arena.literal(static_cast<double>(i)), a);
+	}
+	EXPECT_EQ(arena.size(), size);
+
+	arena.clear();
+	EXPECT_EQ(arena.size(), 0u);
+	EXPECT_EQ(arena.variable(3), 0u);
+}
+
+TEST(JitTestCase, ArithmeticParserTest) {
+	ArithmeticParserInt parser;
+	const JitExpression<int> program{ parser.compile("(a*b+c) * (a*b+c) - (a*b+c) / 2") };
+	EXPECT_EQ(program.native(), ARITHMETIC_PARSER_JIT != 0);
+	const int values[] = { 2, 3, -4 };
+	EXPECT_EQ(program.evaluate(values), 3);
+	EXPECT_EQ(JitExpression<int>{ parser.compile("(4 + 5 * (7 - 3)) - 2") }.evaluate(), 22);
+
+	// division by zero reports the same error and offset as the interpreter
+	const auto divByZero = parser.compile("x + 7 / (x - 1)");
+	const int one[] = { 1 };
+	const auto expected = divByZero.tryEvaluate(one);
+	const JitExpression<int> native{ divByZero };
+	const auto result = native.tryEvaluate(one);
+	EXPECT_EQ(result.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(result.offset(), expected.offset());
+	EXPECT_THROW((void)native.evaluate(one), ParserException);
+	EXPECT_EQ(native.tryEvaluate().error(), ErrorCode::UnknownVariable);
+
+	// deeper than the register pool, the interpreter is used
+	const JitExpression<int> deep{ parser.compile("1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + x)))))))))))") };
+	EXPECT_FALSE(deep.native());
+	EXPECT_EQ(deep.evaluate(one), 79);
+
+	ArithmeticParserDouble doubleParser;
+	const JitExpression<double> formula{ doubleParser.compile("(x * 0.5 + y) / (x - y) - 1e300 * 0") };
+	EXPECT_EQ(formula.native(), ARITHMETIC_PARSER_JIT != 0);
+	for (int i = 0; i < 100; i++) {
+		const double xy[] = { i * 1.25, i * -0.75 + 3 };
+		const auto interpreted = formula.program().tryEvaluate(xy);
+		const auto jitted = formula.tryEvaluate(xy);
+		ASSERT_EQ(jitted.error(), interpreted.error());
+		if (interpreted) {
+			EXPECT_EQ(jitted.value(), interpreted.value());
+		}
+		else {
+			EXPECT_EQ(jitted.offset(), interpreted.offset());
+		}
+	}
+	const double same[] = { 2.0, 2.0 };
+	EXPECT_EQ(formula.tryEvaluate(same).error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(JitExpression<double>{ CompiledExpression<double>{} }.tryEvaluate().error(), ErrorCode::EmptyExpression);
+}
+
+TEST(TieredExpressionTestCase, ArithmeticParserTest) {
+	// the upgrade runs on the pool, wait until it is done
+	const auto waitForUpgrade = [](const auto& expression) {
+		for (int i = 0; i < 500 && !expression.settled(); i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return expression.tier();
+	};
+
+	ThreadPool pool{ 2 };
+	ArithmeticParserInt parser;
+	const TieredExpression<int> hot{ parser.compile("(a*b+c) * (a*b+c) - (a*b+c) / 2"), pool, 10 };
+	const int values[] = { 2, 3, -4 };
+	for (int i = 0; i < 9; i++) {
+		EXPECT_EQ(hot.evaluate(values), 3);
+	}
+	EXPECT_FALSE(hot.settled());	// below the threshold nothing is queued
+	EXPECT_EQ(hot.tier(), Tier::Interpreted);
+	EXPECT_EQ(hot.invocations(), 9u);
+	EXPECT_EQ(hot.evaluate(values), 3);
+	EXPECT_TRUE(waitForUpgrade(hot) == Tier::Native || !ARITHMETIC_PARSER_JIT);
+	EXPECT_EQ(hot.evaluate(values), 3);
+	EXPECT_EQ(hot.invocations(), 10u);	// nothing is counted after the upgrade was queued
+
+	// errors keep the offsets of the interpreter on every tier
+	const auto divByZero = parser.compile("x + 7 / (x - 1)");
+	const int one[] = { 1 };
+	const auto expected = divByZero.tryEvaluate(one);
+	const TieredExpression<int> eager{ divByZero, pool, 0 };
+	EXPECT_TRUE(waitForUpgrade(eager) == Tier::Native || !ARITHMETIC_PARSER_JIT);
+	EXPECT_EQ(eager.tryEvaluate(one).error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(eager.tryEvaluate(one).offset(), expected.offset());
+	EXPECT_THROW((void)eager.evaluate(one), ParserException);
+
+	// too deep for the JIT, stays interpreted or moves to the fastest engine
+	const TieredExpression<int> deep{ parser.compile("1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + x)))))))))))"), pool, 0 };
+	EXPECT_NE(waitForUpgrade(deep), Tier::Native);
+	EXPECT_TRUE(deep.settled());
+	EXPECT_EQ(deep.evaluate(one), 79);
+
+	// types without a JIT as well
+	const TieredExpression<float> single{ ArithmeticParserFloat{}.compile("x * (0.5 + x) * (x - 1) / (x + 2)"), pool, 0 };
+	EXPECT_NE(waitForUpgrade(single), Tier::Native);
+	EXPECT_TRUE(single.settled());
+	const float x[] = { 3.0f };
+	EXPECT_EQ(single.evaluate(x), 3.0f * 3.5f * 2.0f / 5.0f);
+
+	// concurrent callers cross the threshold once and all see correct results
+	const TieredExpression<int> shared{ parser.compile("a * a + 1"), pool, 1000 };
+	std::vector<std::thread> threads;
+	std::vector<int> failures(4);
+	for (std::size_t t = 0; t < failures.size(); t++) {
+		threads.emplace_back([&, t]() {
+			for (int i = 0; i < 5000; i++) {
+				const int a[] = { i % 100 };
+				if (shared.evaluate(a) != (i % 100) * (i % 100) + 1) {
+					failures[t]++;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(failures, std::vector<int>(failures.size(), 0));
+	waitForUpgrade(shared);
+	EXPECT_TRUE(shared.settled());
+	EXPECT_GE(shared.invocations(), 1000u);	// callers racing past the threshold may add a few
+}
+
+TEST(ExpressionCacheTestCase, ArithmeticParserTest) {
+	ExpressionCache<int> cache;
+	EXPECT_EQ(cache.evaluate("(4 + 5 * (7 - 3)) - 2"), 22);
+	EXPECT_EQ(cache.evaluate("(4+5*(7-3))-2"), 22);	// same text without the whitespace
+	EXPECT_EQ(cache.get(" ( 4 + 5 * ( 7 - 3 ) ) - 2 "), cache.get("(4+5*(7-3))-2"));	// shared program
+	auto stats = cache.statistics();
+	EXPECT_EQ(stats.misses, 1u);
+	EXPECT_EQ(stats.hits, 3u);
+	EXPECT_EQ(stats.entries, 1u);
+
+	// whitespace between two tokens is kept
+	EXPECT_EQ(cache.evaluate("12"), 12);
+	EXPECT_EQ(cache.tryEvaluate("1 2").error(), ErrorCode::MissingOperator);
+	ExpressionCache<double> exponents;
+	EXPECT_EQ(exponents.evaluate("1e+5"), 1e5);
+	EXPECT_EQ(exponents.tryEvaluate("1e +5").error(), ErrorCode::MissingOperator);	// 1, e and +5
+
+	// errors keep the offsets of the given text and are not cached
+	const auto error = cache.tryEvaluate("  5 / 0 +");
+	EXPECT_EQ(error.error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(cache.tryGet("(1 + 2").offset(), 0u);
+	EXPECT_THROW((void)cache.get("(1 + 2"), ParserException);
+	stats = cache.statistics();
+	EXPECT_EQ(stats.entries, 3u);	// 22, 12 and 5 / 0 +
+
+	// a small limit keeps only the most recently used entries
+	ExpressionCache<int> small{ 4096, 1 };
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(small.evaluate(std::to_string(i) + " + 1"), i + 1);
+	}
+	stats = small.statistics();
+	EXPECT_GT(stats.evictions, 900u);
+	EXPECT_LE(stats.memory, 4096u);
+	EXPECT_EQ(stats.entries + stats.evictions, 1000u);
+
+	// the limit counts the code of every engine, not only the postfix program
+	std::string sum = "x0";
+	for (int i = 1; i < 50; i++) {
+		sum += " * x" + std::to_string(i) + " + " + std::to_string(i);
+	}
+	auto program = ArithmeticParserInt{}.compile(sum);
+	const auto footprint = program.memoryUsage();
+	EXPECT_GE(footprint, (program.size() + program.bytecodeSize()) * sizeof(Instruction<int>));
+	program.setEngine(Engine::Register);
+	EXPECT_GE(program.memoryUsage(), footprint + program.bytecodeSize() * sizeof(RegisterInstruction<int>));
+	const std::size_t limit = 32 * 1024;
+	ExpressionCache<int> bounded{ limit, 1 };
+	for (int i = 0; i < 100; i++) {
+		EXPECT_GE(bounded.get(sum + " - " + std::to_string(i))->memoryUsage(), footprint);
+	}
+	stats = bounded.statistics();
+	EXPECT_LE(stats.memory, limit);
+	EXPECT_GE(stats.memory, stats.entries * footprint);
+	EXPECT_LE(stats.entries, limit / footprint);
+	EXPECT_EQ(stats.entries + stats.evictions, 100u);
+
+	// a long expression normalized before on this thread does not inflate the cost of short ones
+	std::string longExpr = "1";
+	while (longExpr.size() < 200000) {
+		longExpr += " + 1";
+	}
+	ExpressionCache<int> other;
+	EXPECT_EQ(other.evaluate(longExpr), static_cast<int>((longExpr.size() + 3) / 4));
+	ExpressionCache<int> tiny{ 1024 * 1024, 1 };
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(tiny.evaluate(std::to_string(i) + "+1"), i + 1);
+	}
+	stats = tiny.statistics();
+	EXPECT_EQ(stats.entries, 100u);
+	EXPECT_EQ(stats.evictions, 0u);
+	EXPECT_LT(stats.memory, 100u * 1024);
+
+	// concurrent lookups of the same expressions
+	ExpressionCache<int> shared;
+	std::vector<std::thread> threads;
+	std::vector<int> failures(4);
+	for (std::size_t t = 0; t < failures.size(); t++) {
+		threads.emplace_back([&, t]() {
+			for (int i = 0; i < 5000; i++) {
+				if (shared.evaluate(std::to_string(i % 100) + " * 2") != (i % 100) * 2) {
+					failures[t]++;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(failures, std::vector<int>(failures.size(), 0));
+	stats = shared.statistics();
+	EXPECT_EQ(stats.hits + stats.misses, 20000u);
+	EXPECT_EQ(stats.entries, 100u);
+}
+
+TEST(ThreadPoolTestCase, ArithmeticParserTest) {
+	ThreadPool pool{ 4 };
+	EXPECT_EQ(pool.size(), 4u);
+
+	// every range is visited exactly once, also when the ranges are uneven
+	std::vector<std::atomic<int>> visits(10007);
+	pool.parallelFor(visits.size(), 64, [&visits](std::size_t first, std::size_t last) {
+		for (auto i = first; i < last; i++) {
+			visits[i].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+	std::size_t wrong = 0;
+	for (const auto& visit : visits) {
+		wrong += visit.load() != 1;
+	}
+	EXPECT_EQ(wrong, 0u);
+
+	// nested parallelFor from inside a task
+	std::atomic<int> sum{};
+	pool.parallelFor(8, 1, [&pool, &sum](std::size_t, std::size_t) {
+		pool.parallelFor(100, 10, [&sum](std::size_t first, std::size_t last) {
+			sum.fetch_add(static_cast<int>(last - first));
+		});
+	});
+	EXPECT_EQ(sum.load(), 800);
+}
+
+TEST(EvaluateAllTestCase, ArithmeticParserTest) {
+	ThreadPool pool{ 4 };
+
+	// expressions of very different lengths and some errors, in input order
+	std::vector<std::string> storage;
+	for (int i = 0; i < 20000; i++) {
+		if (i % 97 == 0) {
+			storage.push_back(std::to_string(i) + " / 0");
+		}
+		else if (i % 1000 == 1) {
+			std::string expr = std::to_string(i);
+			for (int k = 0; k < 500; k++) {
+				expr += " + 1 - 1";
+			}
+			storage.push_back(expr);
+		}
+		else {
+			storage.push_back(std::to_string(i) + " * 2 - " + std::to_string(i));
+		}
+	}
+	const std::vector<std::string_view> expressions(storage.begin(), storage.end());
+
+	std::vector<Result<int>> results;
+	evaluateAll(expressions, results, pool);
+	ASSERT_EQ(results.size(), expressions.size());
+	std::size_t wrong = 0;
+	for (int i = 0; i < static_cast<int>(results.size()); i++) {
+		if (i % 97 == 0) {
+			wrong += results[i].error() != ErrorCode::DivisionByZero;
+		}
+		else {
+			wrong += !results[i] || results[i].value() != i;
+		}
+	}
+	EXPECT_EQ(wrong, 0u);
+
+	// a part of the expressions through pointer and count
+	Result<int> part[3];
+	evaluateAll(expressions.data() + 96, 3, part, pool);
+	EXPECT_EQ(part[0].value(), 96);
+	EXPECT_EQ(part[1].error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(part[2].value(), 98);
+
+#if defined(__cpp_lib_span)
+	std::vector<Result<int>> spanResults(expressions.size());
+	evaluateAll(std::span<const std::string_view>{ expressions }, std::span<Result<int>>{ spanResults }, pool);
+	EXPECT_EQ(spanResults[98].value(), 98);
+	std::vector<Result<int>> shortResults(expressions.size() - 1);
+	EXPECT_THROW(evaluateAll(std::span<const std::string_view>{ expressions }, std::span<Result<int>>{ shortResults }, pool),
+		std::invalid_argument);
+#endif
+
+	// nothing to do
+	std::vector<Result<int>> none;
+	evaluateAll(std::vector<std::string_view>{}, none, pool);
+	EXPECT_TRUE(none.empty());
+}
+
+#if defined(__cpp_lib_coroutine) && defined(__cpp_lib_span)
+namespace {
+	// coroutine which starts at once and is never awaited, enough to drive evaluateAsync
+	struct Detached
+	{
+		struct promise_type
+		{
+			Detached get_return_object() noexcept { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+	};
+
+	template<typename T>
+	Detached evaluateInto(AsyncEvaluator<T>& evaluator, std::string_view expr, std::span<const T> variables,
+		Result<T>& result, std::atomic<int>& done)
+	{
+		result = co_await evaluator.evaluateAsync(expr, variables);
+		done.fetch_add(1);
+	}
+
+	void waitFor(const std::atomic<int>& done, const int count)
+	{
+		for (int i = 0; i < 500 && done.load() < count; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+}
+
+TEST(AsyncEvaluationTestCase, ArithmeticParserTest) {
+	// requests queued while the only worker is busy share one batch, also across spellings
+	ThreadPool pool{ 1 };
+	AsyncEvaluator<int> evaluator{ pool };
+	std::atomic<bool> release{};
+	const auto blockPool = [&pool, &release]() {
+		release = false;
+		pool.submit([&release] {
+			while (!release.load()) {
+				std::this_thread::yield();
+			}
+		});
+	};
+	blockPool();
+	constexpr int const count = 100;
+	std::vector<std::array<int, 2>> variables(count);
+	std::vector<Result<int>> results(count);
+	std::atomic<int> done{};
+	for (int i = 0; i < count; i++) {
+		variables[i] = { i, i + 1 };
+		evaluateInto<int>(evaluator, i % 2 == 0 ? "a * b - 1" : " a*b-1 ", variables[i], results[i], done);
+	}
+	EXPECT_EQ(done.load(), 0);	// all suspended
+	release = true;
+	waitFor(done, count);
+	ASSERT_EQ(done.load(), count);
+	for (int i = 0; i < count; i++) {
+		EXPECT_EQ(results[i].value(), i * (i + 1) - 1);
+	}
+	auto stats = evaluator.statistics();
+	EXPECT_EQ(stats.requests, 100u);
+	EXPECT_EQ(stats.batches, 1u);
+
+	// a row which divides by zero fails on its own
+	blockPool();
+	done = 0;
+	const int rows[][2] = { { 6, 8 }, { 5, 5 }, { 9, 12 } };
+	for (int i = 0; i < 3; i++) {
+		evaluateInto<int>(evaluator, "a / (b - a)", rows[i], results[i], done);
+	}
+	release = true;
+	waitFor(done, 3);
+	ASSERT_EQ(done.load(), 3);
+	EXPECT_EQ(results[0].value(), 3);
+	EXPECT_EQ(results[1].error(), ErrorCode::DivisionByZero);
+	EXPECT_EQ(results[1].offset(), 2u);
+	EXPECT_EQ(results[2].value(), 3);
+
+	// malformed expressions and missing variables complete without suspending
+	done = 0;
+	evaluateInto<int>(evaluator, "(1 + 2", {}, results[0], done);
+	evaluateInto<int>(evaluator, "a + b", std::span<const int>{ rows[0], 1 }, results[1], done);
+	EXPECT_EQ(done.load(), 2);
+	EXPECT_FALSE(results[0]);
+	EXPECT_EQ(results[1].error(), ErrorCode::UnknownVariable);
+	EXPECT_EQ(evaluator.statistics().requests, 103u);
+
+	// requests from several threads on the evaluator's own pool
+	AsyncEvaluator<double> shared{ 2 };
+	std::vector<std::thread> threads;
+	std::vector<std::vector<double>> inputs(4, std::vector<double>(250));
+	std::vector<std::vector<Result<double>>> outputs(4, std::vector<Result<double>>(250));
+	done = 0;
+	for (std::size_t t = 0; t < inputs.size(); t++) {
+		threads.emplace_back([&, t]() {
+			for (std::size_t i = 0; i < inputs[t].size(); i++) {
+				inputs[t][i] = static_cast<double>(i);
+				evaluateInto<double>(shared, "x * 0.5 + 1", std::span<const double>{ &inputs[t][i], 1 }, outputs[t][i], done);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	waitFor(done, 1000);
+	ASSERT_EQ(done.load(), 1000);
+	for (std::size_t t = 0; t < outputs.size(); t++) {
+		for (std::size_t i = 0; i < outputs[t].size(); i++) {
+			EXPECT_EQ(outputs[t][i].value(), i * 0.5 + 1);
+		}
+	}
+	EXPECT_EQ(shared.statistics().requests, 1000u);
+	EXPECT_LE(shared.statistics().batches, 1000u);
+}
+#endif
+
+TEST(StreamEvaluationTestCase, ArithmeticParserTest) {
+	ThreadPool pool{ 4 };
+
+	// enough lines for several chunks, with errors, empty lines and Windows line breaks
+	std::string text;
+	std::string expected;
+	for (int i = 0; i < 50000; i++) {
+		if (i % 101 == 0) {
+			text += std::to_string(i) + " / 0\r\n";
+			expected += "error at " + std::to_string(std::to_string(i).size() + 1) + ": cannot divide by zero\n";
+		}
+		else if (i % 1001 == 0) {
+			text += "\n";
+			expected += "error at 0: Nothing to do parse!\n";
+		}
+		else {
+			text += std::to_string(i) + " * 2 - " + std::to_string(i) + "\n";
+			expected += std::to_string(i) + "\n";
+		}
+	}
+	text += "7 + 8";	// last line without line break
+	expected += "15\n";
+
+	StreamEvaluator<int> evaluator{ pool };
+	std::string output;
+	std::size_t pieces = 0;
+	evaluator.evaluate(text, [&](std::string_view piece) {
+		output += piece;
+		pieces++;
+	});
+	EXPECT_GT(pieces, 1u);
+	EXPECT_EQ(output, expected);
+	auto stats = evaluator.statistics();
+	EXPECT_EQ(stats.lines, 50001u);
+	EXPECT_EQ(stats.bytes, text.size());
+
+	// the same through files, with windows much smaller than the file
+	const auto input = std::filesystem::temp_directory_path() / "ArithmeticParserStreamInput.txt";
+	const auto result = std::filesystem::temp_directory_path() / "ArithmeticParserStreamOutput.txt";
+	std::ofstream{ input, std::ios::binary } << text;
+	StreamEvaluator<int> windowed{ pool, 4096 };
+	windowed.evaluateFile(input.string().c_str(), result.string().c_str());
+	std::ifstream written{ result, std::ios::binary };
+	const std::string fileOutput{ std::istreambuf_iterator<char>{ written }, std::istreambuf_iterator<char>{} };
+	EXPECT_EQ(fileOutput, expected);
+	EXPECT_EQ(windowed.statistics().errors, stats.errors);
+	written.close();
+	std::filesystem::remove(input);
+	std::filesystem::remove(result);
+
+	// lines longer than the limit are skipped instead of growing the window without bound
+	std::string longLine = "1";
+	while (longLine.size() < 6000) {
+		longLine += " + 1";
+	}
+	std::string hugeLine = "1";
+	while (hugeLine.size() < 30000) {
+		hugeLine += " + 1";
+	}
+	const auto longText = "1 + 2\n" + longLine + "\n" + hugeLine + "\n3 * 3\n" + hugeLine;
+	std::ofstream{ input, std::ios::binary } << longText;
+	StreamEvaluator<int> limited{ pool, 1024, 8192 };
+	limited.evaluateFile(input.string().c_str(), result.string().c_str());
+	std::ifstream limitedOutput{ result, std::ios::binary };
+	const std::string limitedText{ std::istreambuf_iterator<char>{ limitedOutput }, std::istreambuf_iterator<char>{} };
+	EXPECT_EQ(limitedText, "3\n" + std::to_string((longLine.size() + 3) / 4) +
+		"\nerror at 8192: line too long\n9\nerror at 8192: line too long\n");
+	EXPECT_EQ(limited.statistics().lines, 5u);
+	EXPECT_EQ(limited.statistics().errors, 2u);
+	EXPECT_EQ(limited.statistics().bytes, longText.size());
+	limitedOutput.close();
+
+	// by default lines must fit into the window, which then never grows
+	StreamEvaluator<int> fixed{ pool, 8192 };
+	fixed.evaluateFile(input.string().c_str(), result.string().c_str());
+	std::ifstream fixedOutput{ result, std::ios::binary };
+	const std::string fixedText{ std::istreambuf_iterator<char>{ fixedOutput }, std::istreambuf_iterator<char>{} };
+	EXPECT_EQ(fixedText, "3\n" + std::to_string((longLine.size() + 3) / 4) +
+		"\nerror at 8191: line too long\n9\nerror at 8191: line too long\n");
+	fixedOutput.close();
+	std::filesystem::remove(input);
+	std::filesystem::remove(result);
+
+	EXPECT_THROW(windowed.evaluateFile("does/not/exist.txt", "-"), std::system_error);
+}
+
+TEST(ConstantExpressionTestCase, ArithmeticParserTest) {
+	// evaluated by the compiler
+	static_assert(evaluateConstant<int>("(4 + 5 * (7 - 3)) - 2") == 22, "constant expression");
+	static_assert(evaluateConstant<double>("1.5 * .5 + 1e2") == 100.75, "constant expression");
+	static_assert(evaluateConstant<int>("+5") == 5, "unary plus");
+	static_assert(tryEvaluateConstant<int>("5 /2 + 4 / 0").error() == ErrorCode::DivisionByZero, "constant error");
+	static_assert(tryEvaluateConstant<int>("5 /2 + 4 / 0").offset() == 9, "constant error offset");
+	static_assert(tryEvaluateConstant<int>("x + 1").error() == ErrorCode::UnknownVariable, "no variables");
+	static_assert(tryEvaluateConstant<double>("1e30").value() == 1e30, "exact large literal");
+	static_assert(tryEvaluateConstant<double>("0.1234567890123456789").error() == ErrorCode::LiteralOutOfRange,
+		"literals which do not convert exactly");
+
+	// at run time the same expressions give the same results and errors as the parser
+	const char* expressions[] = {
+		"(4 + 5 * (7 - 3)) - 2", "4+5+7/2", "10 + 1", "-10", "((((7 (* 4)))", "(5 + 2) + (5 - 2",
+		"-1", "))) 5 + 2 (((", "+5", "*2", "5 /2 + 4 / 0", "     ", "", "1 2", "2 * (3 + 4) / 7 - 1",
+		"99999999999999999999", "2147483647", "2147483648", "12 % 5", "+", "()", "(1) + (2 * (3))",
+		"0.5 + .25", "3e2 - 1.5E-1", "1e", "7 / 2 * 2", "000012 + 00", "8 - 3 - 2", "8 / 4 / 2",
+	};
+	ArithmeticParserInt intParser;
+	ArithmeticParserDouble doubleParser;
+	for (const auto expr : expressions) {
+		const auto expected = intParser.tryEvaluate(expr);
+		const auto actual = detail::ConstantParser<int>::evaluate<64>(expr);
+		EXPECT_EQ(actual.error(), expected.error()) << expr;
+		EXPECT_EQ(actual.offset(), expected.offset()) << expr;
+		EXPECT_EQ(actual.valueOr(0), expected.valueOr(0)) << expr;
+
+		const auto expectedDouble = doubleParser.tryEvaluate(expr);
+		const auto actualDouble = detail::ConstantParser<double>::evaluate<64>(expr);
+		if (actualDouble.error() == ErrorCode::LiteralOutOfRange && expectedDouble) {
+			// 20 significant digits do not convert exactly, only the parser rounds them
+			EXPECT_EQ(std::string_view{ expr }, "99999999999999999999");
+			continue;
+		}
+		EXPECT_EQ(actualDouble.error(), expectedDouble.error()) << expr;
+		EXPECT_EQ(actualDouble.offset(), expectedDouble.offset()) << expr;
+		EXPECT_EQ(actualDouble.valueOr(0), expectedDouble.valueOr(0)) << expr;
+	}
+
+	// outside constant evaluation a malformed expression throws like parseAndEvaluate
+	EXPECT_THROW((void)evaluateConstant<int>("(1 + 2"), ParserException);
+}
+
+#if ARITHMETIC_PARSER_EXPRESSION_LITERAL
+TEST(ExpressionLiteralTestCase, ArithmeticParserTest) {
+	using namespace Parser::literals;
+
+	constexpr auto formula = "a * b + c"_expr;
+	static_assert(formula(2, 3, 4) == 10, "evaluated by the compiler");
+	static_assert(decltype(formula)::variableCount() == 3, "variables in order of appearance");
+	static_assert("(4 + 5 * (7 - 3)) - 2"_expr() == 22, "no variables");
+	static_assert("x / 2.5 - .5"_expr(5.0) == 1.5, "floating point literals");
+
+	// the same values as the compiled program, variables in the same slots
+	ArithmeticParserDouble parser;
+	const auto program = parser.compile("(y - x) * (x + 2) / y - x * x");
+	for (int i = 1; i < 50; i++) {
+		const double values[] = { i * 0.75, i * 1.5 - 3 };
+		if (values[1] == 0) {
+			continue;
+		}
+		EXPECT_EQ("(y - x) * (x + 2) / y - x * x"_expr(values[0], values[1]), program.evaluate(values));
+	}
+
+	// integer arithmetic and mixed argument types
+	EXPECT_EQ("7 / a * a + 7 - 7 / a * a"_expr(2), 7);
+	EXPECT_EQ("a + b"_expr(1, 2.5), 3.5);
+	EXPECT_EQ(decltype("a + b"_expr)::evaluate<int>(1, 2.5), 3);
+
+	// division by zero throws at run time, with the offset of the operator
+	try {
+		(void)"a + 1 / (a - a)"_expr(3);
+		FAIL() << "no exception";
+	}
+	catch (const ParserException& ex) {
+		EXPECT_EQ(ex.getErrorCode(), ErrorCode::DivisionByZero);
+		EXPECT_EQ(ex.getOffset(), 6u);
+	}
+}
+#endif
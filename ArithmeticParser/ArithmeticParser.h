@@ -31,264 +31,2650 @@
 #define ARITHMETIC_PARSER
 
 #include <string>
-#include <stack>
+#include <string_view>
+#include <vector>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <limits>
+#include <type_traits>
+#include <functional>
+#include <cmath>
 
-#if __cplusplus >= 201703L
-#define NODISCARD   [[nodiscard]]
-#define INLINE      inline
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#if !defined(__cpp_lib_to_chars)
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#endif
+
+#include "ParserConfig.h"
+
+// number of operators and values kept inside the parser before its stacks spill to the heap
+#ifndef ARITHMETIC_PARSER_STACK_DEPTH
+#define ARITHMETIC_PARSER_STACK_DEPTH   32
+#endif
+
+// SWAR digit parsing loads 8 characters into an integer and expects little-endian byte order
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define ARITHMETIC_PARSER_SWAR  1
+#else
+#define ARITHMETIC_PARSER_SWAR  0
+#endif
+
+// the interpreter dispatches with computed goto (labels as values) where the compiler has it,
+// every instruction then jumps straight to the next one instead of returning to a switch.
+// define as 0 for the portable switch
+#ifndef ARITHMETIC_PARSER_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define ARITHMETIC_PARSER_COMPUTED_GOTO 1
+#else
+#define ARITHMETIC_PARSER_COMPUTED_GOTO 0
+#endif
+#endif
+
+// closures evaluate a program recursively, taller expression trees stay on the interpreter
+#ifndef ARITHMETIC_PARSER_CLOSURE_DEPTH
+#define ARITHMETIC_PARSER_CLOSURE_DEPTH 1024
+#endif
+
+#include "BatchKernels.h"
+
+namespace Parser
+{
+    // reasons why an expression could not be parsed or evaluated
+    enum class ErrorCode : unsigned char
+    {
+        None = 0,
+        EmptyExpression,
+        UnbalancedParentheses,
+        InvalidToken,
+        LiteralTooLarge,
+        LiteralOutOfRange,
+        UnaryMinus,
+        MissingOperand,
+        MissingOperator,
+        DivisionByZero,
+        UnknownVariable,
+        OutOfMemory
+    };
+
+    /*
+    *	Gets a human readable message for the given error code.
+    *	returns: Error message, an empty string for ErrorCode::None.
+    *	exception: This function never throws an exception.
+    */
+    constexpr const char* errorMessage(const ErrorCode code) noexcept
+    {
+        switch (code) {
+        case ErrorCode::None:
+            break;
+        case ErrorCode::EmptyExpression:
+            return "Nothing to do parse!";
+        case ErrorCode::UnbalancedParentheses:
+            return "unbalanced parentheses!";
+        case ErrorCode::InvalidToken:
+            return "Invalid token.";
+        case ErrorCode::LiteralTooLarge:
+            return "Literal is too large!";
+        case ErrorCode::LiteralOutOfRange:
+            return "Literal is out of range!";
+        case ErrorCode::UnaryMinus:
+            return "negative literal or unary minus";
+        case ErrorCode::MissingOperand:
+            return "missing operand";
+        case ErrorCode::MissingOperator:
+            return "missing operator";
+        case ErrorCode::DivisionByZero:
+            return "cannot divide by zero";
+        case ErrorCode::UnknownVariable:
+            return "unknown variable";
+        case ErrorCode::OutOfMemory:
+            return "out of memory";
+        }
+        return "";
+    }
+
+    class ParserException
+    {
+    public:
+        ParserException() noexcept = default;
+        ParserException(const std::string& err_msg) noexcept : 
+            m_error_msg{ err_msg } 
+        {
+        }
+
+        ParserException(std::string&& err_msg) noexcept :
+            m_error_msg{ std::move(err_msg) } 
+        {
+        }
+
+        ParserException(const ErrorCode code, const std::size_t offset) noexcept :
+            m_error_msg{ errorMessage(code) },
+            m_error_code{ code },
+            m_offset{ offset }
+        {
+        }
+
+        virtual ~ParserException() = default;
+
+        /*
+        *	Gets an error message for detecting which error occurs.
+        *	returns: Error message.
+        *	exception: This function never throws an exception.
+        */
+        NODISCARD virtual const std::string& getErrorMsg() const noexcept
+		{
+            return m_error_msg;
+        }
+
+        /*
+        *	Gets the error code and the offset of the offending token in the expression.
+        *	returns: ErrorCode::None and 0 for exceptions created from a message.
+        *	exception: This function never throws an exception.
+        */
+        NODISCARD ErrorCode getErrorCode() const noexcept
+        {
+            return m_error_code;
+        }
+
+        NODISCARD std::size_t getOffset() const noexcept
+        {
+            return m_offset;
+        }
+
+    protected:
+        std::string m_error_msg;
+        ErrorCode m_error_code{ ErrorCode::None };
+        std::size_t m_offset{};
+    };
+
+    /*
+    *	Value or error returned by the exception-free API (tryEvaluate, tryCompile).
+    *	offset is the position of the offending token in the expression.
+    */
+    template<typename T>
+    class Result
+    {
+    public:
+        constexpr Result() = default;
+        constexpr Result(T value) noexcept(std::is_nothrow_move_constructible<T>::value) :
+            m_value{ std::move(value) }
+        {
+        }
+
+        constexpr Result(const ErrorCode code, const std::size_t offset) noexcept :
+            m_error_code{ code },
+            m_offset{ offset }
+        {
+        }
+
+        NODISCARD constexpr bool hasValue() const noexcept
+        {
+            return m_error_code == ErrorCode::None;
+        }
+
+        constexpr explicit operator bool() const noexcept
+        {
+            return hasValue();
+        }
+
+        // gets the value, throws ParserException if the result holds an error
+        NODISCARD constexpr const T& value() const&
+        {
+            throwIfError();
+            return m_value;
+        }
+
+        NODISCARD constexpr T&& value() &&
+        {
+            throwIfError();
+            return std::move(m_value);
+        }
+
+        NODISCARD constexpr T valueOr(T fallback) const
+        {
+            return hasValue() ? m_value : std::move(fallback);
+        }
+
+        NODISCARD constexpr ErrorCode error() const noexcept
+        {
+            return m_error_code;
+        }
+
+        NODISCARD constexpr std::size_t offset() const noexcept
+        {
+            return m_offset;
+        }
+
+        NODISCARD constexpr const char* message() const noexcept
+        {
+            return errorMessage(m_error_code);
+        }
+
+    private:
+        constexpr void throwIfError() const
+        {
+            if (!hasValue()) {
+                throw ParserException{ m_error_code, m_offset };
+            }
+        }
+
+        T m_value{};
+        ErrorCode m_error_code{ ErrorCode::None };
+        std::size_t m_offset{};
+    };
+
+    namespace detail
+    {
+        // a 64-bit integer always holds 19 decimal digits without overflow
+        INLINE constexpr auto const MAX_U64_DIGITS = 19;
+
+        constexpr bool isDigit(const char ch) noexcept
+        {
+            return ch >= '0' && ch <= '9';
+        }
+
+        // same characters as std::isspace in the "C" locale
+        constexpr bool isSpace(const char ch) noexcept
+        {
+            return ch == ' ' || (ch >= '\t' && ch <= '\r');
+        }
+
+        // variable names start with a letter or an underscore, followed by letters, digits or underscores
+        constexpr bool isIdentifierStart(const char ch) noexcept
+        {
+            return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+        }
+
+        constexpr bool isIdentifierChar(const char ch) noexcept
+        {
+            return isIdentifierStart(ch) || isDigit(ch);
+        }
+
+#if ARITHMETIC_PARSER_SWAR
+        inline std::uint64_t loadEightChars(const char* first) noexcept
+        {
+            std::uint64_t chunk{};
+            std::memcpy(&chunk, first, sizeof(chunk));
+            return chunk;
+        }
+
+        // check whether all 8 characters of the chunk are ASCII digits
+        constexpr bool isEightDigits(const std::uint64_t chunk) noexcept
+        {
+            return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+        }
+
+        // convert 8 ASCII digits to their value with three multiplications instead of eight
+        constexpr std::uint64_t parseEightDigits(std::uint64_t chunk) noexcept
+        {
+            chunk -= 0x3030303030303030ULL;
+            chunk = (chunk * 10) + (chunk >> 8);
+            return (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        }
+#endif
+
+        /*
+        *	Accumulates the digits in [first, last) into mantissa, 8 digits per step where possible.
+        *	significant: number of digits accumulated so far, digits beyond 19 are only counted in dropped.
+        *	returns: position of the first character which is not a digit.
+        *	exception: This function never throws an exception.
+        */
+        inline const char* scanDigits(const char* first, const char* last,
+            std::uint64_t& mantissa, int& significant, int& dropped) noexcept
+        {
+#if ARITHMETIC_PARSER_SWAR
+            while (last - first >= 8 && significant + 8 <= MAX_U64_DIGITS) {
+                const auto chunk = loadEightChars(first);
+                if (!isEightDigits(chunk)) {
+                    break;
+                }
+                mantissa = mantissa * 100000000ULL + parseEightDigits(chunk);
+                significant += 8;
+                first += 8;
+            }
+#endif
+            for (; first != last && isDigit(*first); ++first) {
+                if (significant < MAX_U64_DIGITS) {
+                    mantissa = mantissa * 10 + static_cast<std::uint64_t>(*first - '0');
+                    ++significant;
+                }
+                else {
+                    ++dropped;
+                }
+            }
+            return first;
+        }
+
+        // limits of the exact floating point conversion (Clinger's fast path):
+        // both the mantissa and the power of ten are exactly representable,
+        // so a single multiplication or division gives a correctly rounded result.
+        template<typename T>
+        struct FastPathLimits
+        {
+            INLINE static constexpr auto const enabled = false;
+            INLINE static constexpr std::uint64_t const max_mantissa = 0;
+            INLINE static constexpr auto const max_exponent = 0;
+        };
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+        template<>
+        struct FastPathLimits<double>
+        {
+            INLINE static constexpr auto const enabled = true;
+            INLINE static constexpr std::uint64_t const max_mantissa = 1ULL << 53;
+            INLINE static constexpr auto const max_exponent = 22;
+        };
+
+        template<>
+        struct FastPathLimits<float>
+        {
+            INLINE static constexpr auto const enabled = true;
+            INLINE static constexpr std::uint64_t const max_mantissa = 1ULL << 24;
+            INLINE static constexpr auto const max_exponent = 10;
+        };
+#endif
+
+        INLINE constexpr double const POWERS_OF_TEN[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+    }
+
+    /*
+    *	Stack which keeps up to N elements inline and only spills to the heap beyond that,
+    *	so typical expressions are parsed and evaluated without any allocation.
+    */
+    template<typename T, std::size_t N = ARITHMETIC_PARSER_STACK_DEPTH>
+    class SmallStack
+    {
+        static_assert(N > 0, "inline capacity must not be zero");
+
+    public:
+        SmallStack() noexcept = default;
+        ~SmallStack()
+        {
+            clear();
+            if (m_heap != nullptr) {
+                std::allocator<T>{}.deallocate(m_heap, m_capacity);
+            }
+        }
+        // non-copyable class
+        SmallStack(const SmallStack&) = delete;
+        SmallStack& operator=(const SmallStack&) = delete;
+
+        // moving takes over the heap block, inline elements are moved one by one
+        SmallStack(SmallStack&& other) noexcept
+        {
+            moveFrom(other);
+        }
+
+        SmallStack& operator=(SmallStack&& other) noexcept
+        {
+            if (this != &other) {
+                clear();
+                if (m_heap != nullptr) {
+                    std::allocator<T>{}.deallocate(m_heap, m_capacity);
+                    m_heap = nullptr;
+                    m_capacity = N;
+                }
+                moveFrom(other);
+            }
+            return *this;
+        }
+
+        void push(const T& val)
+        {
+            if (m_size == m_capacity) {
+                grow();
+            }
+            ::new (static_cast<void*>(data() + m_size)) T(val);
+            ++m_size;
+        }
+
+        void push(T&& val)
+        {
+            if (m_size == m_capacity) {
+                grow();
+            }
+            ::new (static_cast<void*>(data() + m_size)) T(std::move(val));
+            ++m_size;
+        }
+
+        void pop() noexcept
+        {
+            data()[--m_size].~T();
+        }
+
+        NODISCARD T& top() noexcept
+        {
+            return data()[m_size - 1];
+        }
+
+        NODISCARD const T& top() const noexcept
+        {
+            return data()[m_size - 1];
+        }
+
+        // element at the given position counted from the bottom
+        NODISCARD T& operator[](const std::size_t index) noexcept
+        {
+            return data()[index];
+        }
+
+        NODISCARD const T& operator[](const std::size_t index) const noexcept
+        {
+            return data()[index];
+        }
+
+        NODISCARD bool empty() const noexcept
+        {
+            return m_size == 0;
+        }
+
+        NODISCARD std::size_t size() const noexcept
+        {
+            return m_size;
+        }
+
+        NODISCARD std::size_t capacity() const noexcept
+        {
+            return m_capacity;
+        }
+
+        // remove all elements, the allocated capacity is kept for reuse
+        void clear() noexcept
+        {
+            while (m_size != 0) {
+                pop();
+            }
+        }
+
+        // make room for at least the given number of elements
+        void reserve(const std::size_t capacity)
+        {
+            if (capacity > m_capacity) {
+                grow(capacity);
+            }
+        }
+
+    private:
+        T* data() noexcept
+        {
+            return m_heap != nullptr ? m_heap : std::launder(reinterpret_cast<T*>(m_inline));
+        }
+
+        const T* data() const noexcept
+        {
+            return m_heap != nullptr ? m_heap : std::launder(reinterpret_cast<const T*>(m_inline));
+        }
+
+        // this stack must be empty and use its inline storage
+        void moveFrom(SmallStack& other) noexcept
+        {
+            static_assert(std::is_nothrow_move_constructible<T>::value, "elements must be nothrow move constructible");
+            if (other.m_heap != nullptr) {
+                m_heap = other.m_heap;
+                m_size = other.m_size;
+                m_capacity = other.m_capacity;
+                other.m_heap = nullptr;
+                other.m_size = 0;
+                other.m_capacity = N;
+                return;
+            }
+            for (std::size_t i = 0; i < other.m_size; i++) {
+                ::new (static_cast<void*>(data() + i)) T(std::move(other.data()[i]));
+            }
+            m_size = other.m_size;
+            other.clear();
+        }
+
+        // move the elements into a new heap block, doubling the capacity by default
+        void grow(std::size_t capacity = 0)
+        {
+            std::allocator<T> alloc;
+            capacity = (std::max)(capacity, m_capacity * 2);
+            T* const heap = alloc.allocate(capacity);
+            T* const old = data();
+            for (std::size_t i = 0; i < m_size; i++) {
+                ::new (static_cast<void*>(heap + i)) T(std::move_if_noexcept(old[i]));
+                old[i].~T();
+            }
+            if (m_heap != nullptr) {
+                alloc.deallocate(m_heap, m_capacity);
+            }
+            m_heap = heap;
+            m_capacity = capacity;
+        }
+
+        alignas(T) unsigned char m_inline[N * sizeof(T)];	// inline storage for the first N elements
+        T* m_heap{};	// heap storage once the stack grows beyond N elements
+        std::size_t m_size{};
+        std::size_t m_capacity{ N };
+    };
+
+    template<typename T>
+    class ArithmeticParser;
+
+    template<typename T>
+    class CompiledExpression;
+
+    template<typename T>
+    class JitExpression;
+
+    // instructions of a compiled expression. binary operators use
+    // their own character so that they can be passed to callOperator directly.
+    enum class OpCode : char
+    {
+        Push = '#',     // push a literal onto the value stack
+        Load = '$',     // push the value of a variable slot onto the value stack
+        StoreTemp = '>',    // copy the top of the value stack into a temporary, the value stays on the stack
+        LoadTemp = '<',     // push the value of a temporary onto the value stack
+        Add = '+',
+        Sub = '-',
+        Mul = '*',
+        Div = '/',
+        // superinstructions, only found in the interpreter's bytecode (see fuseInstructions)
+        AddLiteral = '0',   // apply the operator to the top of the value stack and a literal
+        SubLiteral = '1',
+        MulLiteral = '2',
+        DivLiteral = '3',   // the literal is never zero
+        AddVariable = '4',  // apply the operator to the top of the value stack and a variable slot
+        SubVariable = '5',
+        MulVariable = '6',
+        MulAdd = '7'        // pop c, b and a, push a + b * c
+    };
+
+    template<typename T>
+    struct Instruction
+    {
+        OpCode opcode;
+        std::uint32_t operand;  // variable slot for OpCode::Load and the XxxVariable opcodes, temporary for
+                                // OpCode::StoreTemp and OpCode::LoadTemp, otherwise position of the token in the expression
+        T value;    // literal value, only meaningful for OpCode::Push and the XxxLiteral opcodes
+    };
+
+    // interpreters a compiled expression can run on, see CompiledExpression::setEngine
+    enum class Engine : unsigned char
+    {
+        Stack,      // postfix bytecode over a value stack, with superinstructions
+        Register,   // three-address code over a small register file
+        Closure     // a precompiled function per node, chosen by operator and operand kinds
+    };
+
+    // where an operand of the register engine is read from
+    enum class RegisterOperand : unsigned char
+    {
+        Register,   // the register file
+        Variable    // the variables passed to evaluate, by slot
+    };
+
+    /*
+    *	Instruction of the register engine: dst = lhs op rhs, dst = lhs op value for the XxxLiteral
+    *	opcodes, or dst = lhs for OpCode::StoreTemp.
+    */
+    template<typename T>
+    struct RegisterInstruction
+    {
+        OpCode opcode;
+        RegisterOperand lhsKind;
+        RegisterOperand rhsKind;
+        std::uint32_t dst;  // register index
+        std::uint32_t lhs;  // register index or variable slot, by kind
+        std::uint32_t rhs;
+        std::uint32_t offset;   // position of the operator in the expression
+        T value;    // right operand of the XxxLiteral opcodes
+    };
+
+    namespace detail
+    {
+        // where an operand of a closure node comes from
+        enum class ClosureOperand : unsigned char
+        {
+            Literal,
+            Variable,
+            Temp,
+            Chain,      // the result of a chain of nodes, only as right operand
+            Accumulator // the result of the previous node of the chain, only as left operand
+        };
+
+        template<typename T>
+        struct ClosureFrame;
+
+        /*
+        *	Node of the closure engine. function is an instance of closureOperation specialized for
+        *	the operator and both operand kinds, so a node neither switches on its operator nor
+        *	pushes its operands. The left spine of a subtree, e.g. ((a + b) * c) - d, is a chain of
+        *	nodes run in a loop, each taking the result of the previous one as left operand, so only
+        *	right operands which are subtrees themselves recurse.
+        *	Nodes refer to each other by index, a copy of the array stays valid.
+        */
+        template<typename T>
+        struct ClosureNode
+        {
+            using Function = T(*)(const ClosureNode& node, ClosureFrame<T>& frame, T accumulator);
+
+            Function function;
+            std::uint32_t lhs;  // variable slot or temporary, by operand kind
+            std::uint32_t rhs;  // variable slot, temporary or first node of a chain
+            std::uint32_t offset;   // position of the operator in the expression
+            std::uint32_t steps;    // number of nodes following the first node of a chain
+            T lhsValue;     // literal operands
+            T rhsValue;
+        };
+
+        template<typename T>
+        struct ClosureFrame
+        {
+            const ClosureNode<T>* nodes;
+            const T* variables;
+            T* temps;
+            ErrorCode error;    // the first error, evaluation goes on with a zero result
+            std::uint32_t offset;
+        };
+
+        template<typename T>
+        T closureChain(const ClosureNode<T>* node, ClosureFrame<T>& frame)
+        {
+            auto accumulator = node->function(*node, frame, T{});
+            for (auto steps = node->steps; steps != 0; --steps) {
+                ++node;
+                accumulator = node->function(*node, frame, accumulator);
+            }
+            return accumulator;
+        }
+
+        template<typename T, ClosureOperand kind>
+        INLINE T closureOperand(const std::uint32_t index, const T& value, ClosureFrame<T>& frame, const T& accumulator)
+        {
+            if constexpr (kind == ClosureOperand::Literal) {
+                return value;
+            }
+            else if constexpr (kind == ClosureOperand::Variable) {
+                return frame.variables[index];
+            }
+            else if constexpr (kind == ClosureOperand::Temp) {
+                return frame.temps[index];
+            }
+            else if constexpr (kind == ClosureOperand::Chain) {
+                return closureChain(frame.nodes + index, frame);
+            }
+            else {
+                return accumulator;
+            }
+        }
+
+        // the left operand is evaluated first, the order of the postfix program
+        template<typename T, OpCode op, ClosureOperand lhsKind, ClosureOperand rhsKind>
+        T closureOperation(const ClosureNode<T>& node, ClosureFrame<T>& frame, const T accumulator)
+        {
+            const T lhs = closureOperand<T, lhsKind>(node.lhs, node.lhsValue, frame, accumulator);
+            const T rhs = closureOperand<T, rhsKind>(node.rhs, node.rhsValue, frame, accumulator);
+            if constexpr (op == OpCode::Add) {
+                return lhs + rhs;
+            }
+            else if constexpr (op == OpCode::Sub) {
+                return lhs - rhs;
+            }
+            else if constexpr (op == OpCode::Mul) {
+                return lhs * rhs;
+            }
+            else {
+                if (rhs == 0) {
+                    if (frame.error == ErrorCode::None) {
+                        frame.error = ErrorCode::DivisionByZero;
+                        frame.offset = node.offset;
+                    }
+                    return T{};
+                }
+                return lhs / rhs;
+            }
+        }
+
+        // a shared subexpression, keeps the result of the chain so far in temporary rhs
+        template<typename T>
+        T closureStore(const ClosureNode<T>& node, ClosureFrame<T>& frame, const T accumulator)
+        {
+            return frame.temps[node.rhs] = accumulator;
+        }
+
+        // first node of a chain which starts with a variable instead of an operator
+        template<typename T>
+        T closureVariable(const ClosureNode<T>& node, ClosureFrame<T>& frame, T)
+        {
+            return frame.variables[node.lhs];
+        }
+
+        template<typename T, OpCode op, ClosureOperand lhs>
+        typename ClosureNode<T>::Function closureFunction(const ClosureOperand rhs) noexcept
+        {
+            switch (rhs) {
+            case ClosureOperand::Literal:
+                return &closureOperation<T, op, lhs, ClosureOperand::Literal>;
+            case ClosureOperand::Variable:
+                return &closureOperation<T, op, lhs, ClosureOperand::Variable>;
+            case ClosureOperand::Temp:
+                return &closureOperation<T, op, lhs, ClosureOperand::Temp>;
+            default:
+                return &closureOperation<T, op, lhs, ClosureOperand::Chain>;
+            }
+        }
+
+        template<typename T, OpCode op>
+        typename ClosureNode<T>::Function closureFunction(const ClosureOperand lhs, const ClosureOperand rhs) noexcept
+        {
+            switch (lhs) {
+            case ClosureOperand::Literal:
+                return closureFunction<T, op, ClosureOperand::Literal>(rhs);
+            case ClosureOperand::Variable:
+                return closureFunction<T, op, ClosureOperand::Variable>(rhs);
+            case ClosureOperand::Temp:
+                return closureFunction<T, op, ClosureOperand::Temp>(rhs);
+            default:
+                return closureFunction<T, op, ClosureOperand::Accumulator>(rhs);
+            }
+        }
+
+        // instance of closureOperation for an operator of the postfix program
+        template<typename T>
+        typename ClosureNode<T>::Function closureFunction(const OpCode op, const ClosureOperand lhs,
+            const ClosureOperand rhs) noexcept
+        {
+            switch (op) {
+            case OpCode::Add:
+                return closureFunction<T, OpCode::Add>(lhs, rhs);
+            case OpCode::Sub:
+                return closureFunction<T, OpCode::Sub>(lhs, rhs);
+            case OpCode::Mul:
+                return closureFunction<T, OpCode::Mul>(lhs, rhs);
+            default:
+                return closureFunction<T, OpCode::Div>(lhs, rhs);
+            }
+        }
+    }
+
+    /*
+    *	Contiguous storage for the expression DAGs built while optimizing a program.
+    *	Nodes refer to their operands by 32-bit index instead of by pointer and literals are
+    *	kept in a pool of their own, so a node takes 12 bytes whatever T is.
+    *	A node is always added after its operands, so a forward scan visits operands before
+    *	the operators using them. Identical subtrees are stored once (hash-consing).
+    *	Nodes are never freed one by one, clear() releases all of them at once and keeps the
+    *	memory for the next program.
+    */
+    template<typename T>
+    class NodeArena
+    {
+    public:
+        struct Node
+        {
+            OpCode opcode;
+            std::uint32_t lhs;  // left operand of an operator, literal index of a Push, variable slot of a Load
+            std::uint32_t rhs;  // right operand of an operator
+        };
+
+        INLINE static constexpr auto const none = (std::numeric_limits<std::uint32_t>::max)();
+
+        NodeArena() = default;
+        // non-copyable class
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        // index of the node, which is added unless an identical one exists already
+        std::uint32_t literal(const T& value);
+        std::uint32_t variable(std::uint32_t slot);
+        std::uint32_t operation(OpCode opcode, std::uint32_t lhs, std::uint32_t rhs);
+
+        NODISCARD const Node& operator[](const std::uint32_t index) const noexcept
+        {
+            return m_nodes[index];
+        }
+
+        // literal value of a Push node
+        NODISCARD const T& value(const Node& node) const noexcept
+        {
+            return m_literals[node.lhs];
+        }
+
+        NODISCARD std::size_t size() const noexcept
+        {
+            return m_nodes.size();
+        }
+
+        // room for count nodes without reallocating or rehashing
+        void reserve(std::size_t count);
+
+        // release all nodes at once
+        void clear() noexcept;
+
+    private:
+        // index of the node equal to candidate, or of candidate after adding it
+        template<typename Equal>
+        std::uint32_t intern(const Node& candidate, std::size_t hash, Equal&& equal);
+        std::size_t hash(const Node& node, const T* literal) const noexcept;
+        void rehash(std::size_t buckets);
+
+        std::vector<Node> m_nodes;
+        std::vector<T> m_literals;
+        std::vector<std::uint32_t> m_table;     // open addressing table of node indices, at most half full
+    };
+
+    static_assert(sizeof(NodeArena<double>::Node) < 16, "arena nodes are meant to stay small");
+
+    /*
+    *	Scratch memory used while evaluating a compiled expression.
+    *	Keep one per thread (or use local()) so that evaluations neither allocate
+    *	nor share mutable state, the capacity grows to the deepest program evaluated.
+    */
+    template<typename T>
+    class EvaluationContext
+    {
+    public:
+        EvaluationContext() noexcept = default;
+        // non-copyable class
+        EvaluationContext(const EvaluationContext&) = delete;
+        EvaluationContext& operator=(const EvaluationContext&) = delete;
+        EvaluationContext(EvaluationContext&&) noexcept = default;
+        EvaluationContext& operator=(EvaluationContext&&) noexcept = default;
+        ~EvaluationContext() = default;
+
+        // context of the calling thread, used by the overloads which do not take one
+        static EvaluationContext& local() noexcept
+        {
+            thread_local EvaluationContext context;
+            return context;
+        }
+
+    private:
+        friend class CompiledExpression<T>;
+
+        std::vector<T> m_values;	// value stack of the stack engine, register file of the register engine
+        std::vector<T> m_temps;	// shared subexpression results of the interpreter
+        std::vector<T> m_blocks;	// column blocks of evaluateBatch
+    };
+
+    /*
+    *	Immutable postfix program produced by ArithmeticParser<T>::compile().
+    *	Lexing and parsing are done once, evaluate() only runs the program,
+    *	so the same expression can be evaluated many times without any string work.
+    *	Literal subexpressions such as (4 * 3) / 2 are folded into one literal while compiling,
+    *	and a subexpression which occurs more than once, e.g. a * b in (a * b + 1) / (a * b),
+    *	is computed once per evaluation and reused from a temporary.
+    *	All const member functions keep their scratch in an EvaluationContext,
+    *	so one instance can be shared by any number of threads without locking.
+    */
+    template<typename T>
+    class CompiledExpression
+    {
+    public:
+        CompiledExpression() noexcept = default;
+
+        // run the program and return the result.
+        // this function throws an exception if an error occurs (e.g. division by zero).
+        NODISCARD T evaluate() const;
+
+        // run the program with the given variable values, indexed by slot.
+        // the array must hold variableCount() values, nothing is looked up by name here.
+        NODISCARD T evaluate(const T* variables) const;
+        NODISCARD T evaluate(const T* variables, EvaluationContext<T>& context) const;
+
+        // same as evaluate() but reports errors in the result instead of throwing.
+        NODISCARD Result<T> tryEvaluate() const noexcept;
+        NODISCARD Result<T> tryEvaluate(const T* variables) const noexcept;
+        NODISCARD Result<T> tryEvaluate(const T* variables, EvaluationContext<T>& context) const noexcept;
+
+        /*
+        *	Evaluates the program for count rows of columnar data: out[i] is the result for
+        *	columns[0][i], columns[1][i], ... where columns holds one array per variable slot.
+        *	Each operator runs over a whole block of rows with vectorized kernels instead of
+        *	walking the program once per row.
+        *	exception: ParserException if any row divides by zero, out is unspecified then.
+        */
+        void evaluateBatch(const T* const* columns, std::size_t count, T* out) const;
+        void evaluateBatch(const T* const* columns, std::size_t count, T* out, EvaluationContext<T>& context) const;
+
+        // number of variable slots the program reads
+        NODISCARD std::size_t variableCount() const noexcept
+        {
+            return m_variables.size();
+        }
+
+        // variable names, the position of a name is its slot index
+        NODISCARD const std::vector<std::string>& variables() const noexcept
+        {
+            return m_variables;
+        }
+
+        // slot index of a variable, or npos if the program does not use it.
+        // meant for setting up the value array once, not for the evaluation loop.
+        NODISCARD std::size_t variableIndex(std::string_view name) const noexcept
+        {
+            const auto iter = std::find(m_variables.cbegin(), m_variables.cend(), name);
+            return iter == m_variables.cend() ? npos : static_cast<std::size_t>(iter - m_variables.cbegin());
+        }
+
+        INLINE static constexpr auto const npos = static_cast<std::size_t>(-1);
+
+        NODISCARD bool empty() const noexcept
+        {
+            return m_code.empty();
+        }
+
+        // number of instructions in the program
+        NODISCARD std::size_t size() const noexcept
+        {
+            return m_code.size();
+        }
+
+        // number of instructions evaluate() dispatches on the selected engine
+        NODISCARD std::size_t bytecodeSize() const noexcept
+        {
+            return m_engine == Engine::Register ? m_registerCode.size() :
+                m_engine == Engine::Closure ? m_closures.size() : m_bytecode.size();
+        }
+
+        /*
+        *	Selects the interpreter of evaluate() and tryEvaluate(), results and errors are the same on all.
+        *	Engine::Register and Engine::Closure translate the program on the first call.
+        *	Expression trees taller than ARITHMETIC_PARSER_CLOSURE_DEPTH keep the current engine
+        *	instead of Engine::Closure, engine() tells which one is used.
+        *	Select the engine before sharing the instance between threads.
+        */
+        void setEngine(Engine engine);
+
+        NODISCARD Engine engine() const noexcept
+        {
+            return m_engine;
+        }
+
+        // bytes the program allocates besides the object itself: the code of every engine built so far and the variable names
+        NODISCARD std::size_t memoryUsage() const noexcept;
+
+    private:
+        friend class ArithmeticParser<T>;
+        friend class JitExpression<T>;
+
+        // evaluation core shared by evaluate and tryEvaluate
+        ErrorCode run(const T* variables, EvaluationContext<T>& context, T& result, std::size_t& offset) const;
+        // run of the register engine
+        ErrorCode runRegisters(const T* variables, EvaluationContext<T>& context, T& result, std::size_t& offset) const;
+        // run of the closure engine
+        ErrorCode runClosures(const T* variables, EvaluationContext<T>& context, T& result, std::size_t& offset) const;
+        // evaluate rows [first, first + count) into out, scratch holds a block per stack entry
+        ErrorCode runBlock(const T* const* columns, std::size_t first, std::size_t count,
+            T* scratch, T* out, std::size_t& offset) const;
+        // replace operators whose operands are both literals with their result
+        void foldConstants();
+        // compute repeated subexpressions once and reload them from temporaries
+        void eliminateCommonSubexpressions();
+        // update m_maxDepth after the program has been rewritten
+        void updateDepth() noexcept;
+        // translate the program into m_bytecode, merging common sequences into superinstructions
+        void fuseInstructions();
+        // translate the program into m_registerCode, a stack slot becomes a register
+        void allocateRegisters();
+        // translate the program into m_closures, false if subtrees nest too deep for recursion
+        bool buildClosures();
+
+        std::vector<Instruction<T>> m_code;	// postfix program
+        std::vector<Instruction<T>> m_bytecode;	// m_code with superinstructions, run by the stack engine
+        std::vector<RegisterInstruction<T>> m_registerCode;	// three-address code, run by the register engine
+        std::vector<T> m_registerLiterals;	// literals of m_registerCode
+        std::vector<std::string> m_variables;	// variable names by slot index
+        std::size_t m_maxDepth{};	// maximum depth of the value stack while evaluating
+        std::size_t m_tempCount{};	// number of temporaries used by the program
+        std::vector<detail::ClosureNode<T>> m_closures;	// chains of closure nodes
+        std::uint32_t m_closureRoot{};	// first node of the chain computing the result
+        std::size_t m_registerCount{};	// size of the register file of m_registerCode
+        std::uint32_t m_registerResult{};	// register or variable slot holding the result of m_registerCode
+        RegisterOperand m_registerResultKind{};
+        Engine m_engine{ Engine::Stack };
+    };
+
+	template<typename T>
+	class ArithmeticParser
+	{
+        INLINE static constexpr auto const BRACE_LEFT = '(';
+        INLINE static constexpr auto const BRACE_RIGHT = ')';
+        INLINE static constexpr auto const OP_INC = '+';
+        INLINE static constexpr auto const OP_MIN = '-';
+        INLINE static constexpr auto const OP_MUL = '*';
+        INLINE static constexpr auto const OP_DIV = '/';
+
+	public:
+        explicit ArithmeticParser() noexcept = default;	// default constructor
+		explicit ArithmeticParser(std::string) noexcept;
+		virtual ~ArithmeticParser() = default;	// destructor
+		// copies only take the expression, each parser keeps its own scratch stacks
+		ArithmeticParser(const ArithmeticParser&);
+		ArithmeticParser& operator=(const ArithmeticParser&);
+		ArithmeticParser(ArithmeticParser&&) noexcept = default;
+		ArithmeticParser& operator=(ArithmeticParser&&) noexcept = default;
+
+        // parse the given expression and evaluate the result.
+        // this function throws an exception if an error occurs.
+        // the parser can be reused afterwards even if an exception was thrown,
+        // its stacks are cleared on each call but keep their capacity.
+        NODISCARD T parseAndEvaluate();
+
+        // parse and evaluate an expression from a caller's buffer without copying it.
+        // the buffer does not have to be null-terminated and is never modified.
+        NODISCARD T parseAndEvaluate(std::string_view strExpr);
+        NODISCARD T parseAndEvaluate(const char* strExpr, std::size_t length);
+
+        // parse the given expression into a program which can be evaluated many times.
+        // this function throws an exception if the expression is malformed.
+        NODISCARD CompiledExpression<T> compile();
+        NODISCARD CompiledExpression<T> compile(std::string_view strExpr);
+        NODISCARD CompiledExpression<T> compile(const char* strExpr, std::size_t length);
+
+        // variables are assigned slots in order of their first appearance by the functions above.
+        // this overload binds them to the given slots instead, e.g. { "a", "b" } puts a in slot 0
+        // and b in slot 1. names which are not in the list are reported as unknown variables.
+        NODISCARD CompiledExpression<T> compile(std::string_view strExpr, const std::vector<std::string_view>& variables);
+
+        // exception-free versions of parseAndEvaluate and compile, errors are reported in the result.
+        // they share the parsing engine with the throwing functions above.
+        NODISCARD Result<T> tryEvaluate() noexcept;
+        NODISCARD Result<T> tryEvaluate(std::string_view strExpr) noexcept;
+        NODISCARD Result<T> tryEvaluate(const char* strExpr, std::size_t length) noexcept;
+        NODISCARD Result<CompiledExpression<T>> tryCompile(std::string_view strExpr) noexcept;
+        NODISCARD Result<CompiledExpression<T>> tryCompile(std::string_view strExpr, const std::vector<std::string_view>& variables) noexcept;
+
+        // setter and getter member functions
+		void setExpression(std::string) noexcept;
+
+        NODISCARD std::string getExpression() const noexcept
+		{
+			return m_strEpxr;
+		}
+	protected:
+        // operator priorities
+        static constexpr int operatorPriority(char) noexcept;
+        // to evaluate result from operands with an operator
+        static constexpr T callOperator(const T&, const T&, char);
+        // same as callOperator, stores the result into val1 and returns an error code instead of throwing
+        static constexpr ErrorCode applyOperator(T& val1, const T& val2, char op) noexcept;
+        //Check an operator is valid or not
+		NODISCARD bool isValidOperator(char op) const noexcept;
+        // check a numeric literal starts at the given position
+        static constexpr bool isLiteralStart(const char* first, const char* last) noexcept;
+        // read the numeric literal at iter and move iter past it
+        static ErrorCode parseLiteral(const char*& iter, const char* last, T& value) noexcept;
+	private:
+        // literal readers for integral and floating point types
+        static ErrorCode parseInteger(const char*& iter, const char* last, T& value) noexcept;
+        static ErrorCode parseFloating(const char*& iter, const char* last, T& value) noexcept;
+
+        // an operator waiting on the operator stack and its position in the expression
+        struct OperatorToken
+        {
+            char op;
+            std::uint32_t offset;
+        };
+
+        friend class CompiledExpression<T>;
+
+        // evaluates operands as soon as the parser reduces an operator
+        class ValueSink;
+        // emits postfix instructions instead of evaluating them
+        class CodeSink;
+
+        // compile into a program, bindings may be null to assign slots automatically
+        ErrorCode compileTo(std::string_view strExpr, const std::vector<std::string_view>* bindings,
+            CompiledExpression<T>& program, std::size_t& offset);
+
+        // shunting-yard loop shared by all parsing functions.
+        // values and operators are reported to the given sink in postfix order.
+        // whitespace is skipped while tokenizing, the expression is never modified.
+        // on error, offset is set to the position of the offending token.
+        template<typename Sink>
+        ErrorCode parse(std::string_view strExpr, Sink& sink, std::size_t& offset);
+
+        // pop an operator and apply it to the sink, depth is the number of values held by the sink
+        template<typename Sink>
+        ErrorCode reduce(Sink& sink, std::size_t& depth, std::size_t& offset);
+
+		SmallStack<OperatorToken> m_Ops;	// store operators into stack
+		SmallStack<T> m_Values;	// store values into stack
+		std::string m_strEpxr;	// string expression for parsing
+	};
+
+    template<typename T>
+    class ArithmeticParser<T>::ValueSink
+    {
+    public:
+        explicit ValueSink(SmallStack<T>& values) noexcept :
+            m_values{ values }
+        {
+        }
+
+        void pushValue(const T& val, std::size_t)
+        {
+            m_values.push(val);
+        }
+
+        // there are no variable values when the expression is evaluated directly
+        ErrorCode pushVariable(std::string_view, std::size_t)
+        {
+            return ErrorCode::UnknownVariable;
+        }
+
+        ErrorCode applyOperator(const char op, std::size_t)
+        {
+            T val2 = std::move(m_values.top());
+            m_values.pop();
+
+            return ArithmeticParser<T>::applyOperator(m_values.top(), val2, op);
+        }
+
+    private:
+        SmallStack<T>& m_values;
+    };
+
+    template<typename T>
+    class ArithmeticParser<T>::CodeSink
+    {
+    public:
+        CodeSink(CompiledExpression<T>& program, const bool bound) noexcept :
+            m_program{ program },
+            m_bound{ bound }
+        {
+        }
+
+        void pushValue(const T& val, const std::size_t offset)
+        {
+            m_program.m_code.push_back(Instruction<T>{ OpCode::Push, static_cast<std::uint32_t>(offset), val });
+            m_program.m_maxDepth = (std::max)(m_program.m_maxDepth, ++m_depth);
+        }
+
+        // resolve the name to its slot once, the program only keeps the index
+        ErrorCode pushVariable(const std::string_view name, std::size_t)
+        {
+            auto slot = m_program.variableIndex(name);
+            if (slot == CompiledExpression<T>::npos) {
+                if (m_bound) {
+                    return ErrorCode::UnknownVariable;
+                }
+                slot = m_program.m_variables.size();
+                m_program.m_variables.emplace_back(name);
+            }
+            m_program.m_code.push_back(Instruction<T>{ OpCode::Load, static_cast<std::uint32_t>(slot), T{} });
+            m_program.m_maxDepth = (std::max)(m_program.m_maxDepth, ++m_depth);
+            return ErrorCode::None;
+        }
+
+        ErrorCode applyOperator(const char op, const std::size_t offset)
+        {
+            m_program.m_code.push_back(Instruction<T>{ static_cast<OpCode>(op), static_cast<std::uint32_t>(offset), T{} });
+            --m_depth;
+            return ErrorCode::None;
+        }
+
+    private:
+        CompiledExpression<T>& m_program;
+        std::size_t m_depth{};
+        bool m_bound;   // only the variables given to compile are allowed
+    };
+
+    template<typename T>
+    ArithmeticParser<T>::ArithmeticParser(std::string strExpr) noexcept :
+        m_strEpxr{ std::move(strExpr) }
+    {
+    }
+
+    template<typename T>
+    ArithmeticParser<T>::ArithmeticParser(const ArithmeticParser& other) :
+        m_strEpxr{ other.m_strEpxr }
+    {
+    }
+
+    template<typename T>
+    ArithmeticParser<T>& ArithmeticParser<T>::operator=(const ArithmeticParser& other)
+    {
+        m_strEpxr = other.m_strEpxr;
+        return *this;
+    }
+
+    template<typename T>
+    T ArithmeticParser<T>::parseAndEvaluate()
+    {
+        return parseAndEvaluate(std::string_view{ m_strEpxr });
+    }
+
+    template<typename T>
+    T ArithmeticParser<T>::parseAndEvaluate(const std::string_view strExpr)
+    {
+        ValueSink sink{ m_Values };
+        std::size_t offset = 0;
+        const auto code = parse(strExpr, sink, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+
+        // Top of 'values' contains result, return it.
+        return m_Values.top();
+    }
+
+    template<typename T>
+    T ArithmeticParser<T>::parseAndEvaluate(const char* strExpr, const std::size_t length)
+    {
+        return parseAndEvaluate(std::string_view{ strExpr, length });
+    }
+
+    template<typename T>
+    CompiledExpression<T> ArithmeticParser<T>::compile()
+    {
+        return compile(std::string_view{ m_strEpxr });
+    }
+
+    template<typename T>
+    CompiledExpression<T> ArithmeticParser<T>::compile(const std::string_view strExpr)
+    {
+        CompiledExpression<T> program;
+        std::size_t offset = 0;
+        const auto code = compileTo(strExpr, nullptr, program, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+
+        return program;
+    }
+
+    template<typename T>
+    CompiledExpression<T> ArithmeticParser<T>::compile(const std::string_view strExpr, const std::vector<std::string_view>& variables)
+    {
+        CompiledExpression<T> program;
+        std::size_t offset = 0;
+        const auto code = compileTo(strExpr, &variables, program, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+
+        return program;
+    }
+
+    template<typename T>
+    CompiledExpression<T> ArithmeticParser<T>::compile(const char* strExpr, const std::size_t length)
+    {
+        return compile(std::string_view{ strExpr, length });
+    }
+
+    template<typename T>
+    Result<T> ArithmeticParser<T>::tryEvaluate() noexcept
+    {
+        return tryEvaluate(std::string_view{ m_strEpxr });
+    }
+
+    template<typename T>
+    Result<T> ArithmeticParser<T>::tryEvaluate(const std::string_view strExpr) noexcept
+    {
+        try {
+            ValueSink sink{ m_Values };
+            std::size_t offset = 0;
+            const auto code = parse(strExpr, sink, offset);
+            if (code != ErrorCode::None) {
+                return Result<T>{ code, offset };
+            }
+            return Result<T>{ m_Values.top() };
+        }
+        catch (const std::bad_alloc&) {
+            // only reachable when a deep expression makes the stacks spill to the heap
+            return Result<T>{ ErrorCode::OutOfMemory, 0 };
+        }
+    }
+
+    template<typename T>
+    Result<T> ArithmeticParser<T>::tryEvaluate(const char* strExpr, const std::size_t length) noexcept
+    {
+        return tryEvaluate(std::string_view{ strExpr, length });
+    }
+
+    template<typename T>
+    Result<CompiledExpression<T>> ArithmeticParser<T>::tryCompile(const std::string_view strExpr) noexcept
+    {
+        try {
+            CompiledExpression<T> program;
+            std::size_t offset = 0;
+            const auto code = compileTo(strExpr, nullptr, program, offset);
+            if (code != ErrorCode::None) {
+                return Result<CompiledExpression<T>>{ code, offset };
+            }
+            return Result<CompiledExpression<T>>{ std::move(program) };
+        }
+        catch (const std::bad_alloc&) {
+            return Result<CompiledExpression<T>>{ ErrorCode::OutOfMemory, 0 };
+        }
+    }
+
+    template<typename T>
+    Result<CompiledExpression<T>> ArithmeticParser<T>::tryCompile(const std::string_view strExpr, const std::vector<std::string_view>& variables) noexcept
+    {
+        try {
+            CompiledExpression<T> program;
+            std::size_t offset = 0;
+            const auto code = compileTo(strExpr, &variables, program, offset);
+            if (code != ErrorCode::None) {
+                return Result<CompiledExpression<T>>{ code, offset };
+            }
+            return Result<CompiledExpression<T>>{ std::move(program) };
+        }
+        catch (const std::bad_alloc&) {
+            return Result<CompiledExpression<T>>{ ErrorCode::OutOfMemory, 0 };
+        }
+    }
+
+    template<typename T>
+    ErrorCode ArithmeticParser<T>::compileTo(const std::string_view strExpr, const std::vector<std::string_view>* bindings,
+        CompiledExpression<T>& program, std::size_t& offset)
+    {
+        if (bindings != nullptr) {
+            program.m_variables.assign(bindings->cbegin(), bindings->cend());
+        }
+        CodeSink sink{ program, bindings != nullptr };
+        const auto code = parse(strExpr, sink, offset);
+        if (code == ErrorCode::None) {
+            program.foldConstants();
+            program.eliminateCommonSubexpressions();
+            program.updateDepth();
+            program.fuseInstructions();
+        }
+        return code;
+    }
+
+    template<typename T>
+    template<typename Sink>
+    ErrorCode ArithmeticParser<T>::parse(const std::string_view strExpr, Sink& sink, std::size_t& offset)
+    {
+        // a previous call may have failed in the middle of parsing
+        m_Ops.clear();
+        m_Values.clear();
+
+        const char* const first = strExpr.data();
+        const char* const last = first + strExpr.size();
+        const char* iter = first;
+
+        // skip the leading whitespaces and check if the expression is empty
+        while (iter != last && detail::isSpace(*iter)) {
+            ++iter;
+        }
+        if (iter == last) {
+            offset = 0;
+			return ErrorCode::EmptyExpression;
+		}
+
+        // the number of values held by the sink, operators are
+        // checked against it instead of the values themselves.
+        std::size_t depth = 0;
+
+        // iterate each character into for loop
+        while (iter != last)
+        {
+            const auto ch = *iter;
+
+            if (detail::isSpace(ch)) {
+                ++iter;
+                continue;
+            }
+
+            // Current token is a number, push
+            // it to stack for numbers.
+            const auto position = static_cast<std::size_t>(iter - first);
+            if (isLiteralStart(iter, last)) {
+                T val{};
+                const auto code = parseLiteral(iter, last, val);
+                if (code != ErrorCode::None) {
+                    offset = position;
+                    return code;
+                }
+                sink.pushValue(val, position);
+                ++depth;
+                continue;
+            }
+
+            // Current token is a variable name.
+            if (detail::isIdentifierStart(ch)) {
+                const char* const name = iter;
+                while (++iter != last && detail::isIdentifierChar(*iter)) {
+                }
+                const auto code = sink.pushVariable(std::string_view{ name, static_cast<std::size_t>(iter - name) }, position);
+                if (code != ErrorCode::None) {
+                    offset = position;
+                    return code;
+                }
+                ++depth;
+                continue;
+            }
+
+            switch (ch)
+            {
+            case BRACE_LEFT:
+                // Current token is an opening
+                // brace, push it to 'ops'
+                m_Ops.push(OperatorToken{ ch, static_cast<std::uint32_t>(position) });
+                break;
+            case BRACE_RIGHT:
+                // Closing brace encountered, solve
+                // entire brace.
+                while (!m_Ops.empty() && m_Ops.top().op != BRACE_LEFT) {
+                    const auto code = reduce(sink, depth, offset);
+                    if (code != ErrorCode::None) {
+                        return code;
+                    }
+                }
+
+                // if we find a right parenthesis when the stack is empty
+                if (m_Ops.empty()) {
+                    offset = position;
+					return ErrorCode::UnbalancedParentheses;
+				}
+				m_Ops.pop();    // pop opening brace.
+                break;
+
+            default:
+                // Current token is an operator.
+                if (!isValidOperator(ch)) {
+                    offset = position;
+					return ErrorCode::InvalidToken;
+				}
+
+                // While top of 'ops' has same or greater
+                // precedence to current token, which
+                // is an operator. Apply operator on top
+                // of 'ops' to top two elements in values stack.
+                while (!m_Ops.empty() && operatorPriority(m_Ops.top().op)
+                    >= operatorPriority(ch)) {
+                    const auto code = reduce(sink, depth, offset);
+                    if (code != ErrorCode::None) {
+                        return code;
+                    }
+                }
+
+                // Push current token to 'ops'.
+                m_Ops.push(OperatorToken{ ch, static_cast<std::uint32_t>(position) });
+                break;
+            }
+            ++iter;
+        }
+
+        // Entire expression has been parsed at this
+        // point, apply remaining ops to remaining
+        // values.
+        while (!m_Ops.empty()) {
+            // if there is still a left parenthesis at the top of the stack
+            if (m_Ops.top().op == BRACE_LEFT) {
+                offset = m_Ops.top().offset;
+				return ErrorCode::UnbalancedParentheses;
+			}
+
+            const auto code = reduce(sink, depth, offset);
+            if (code != ErrorCode::None) {
+                return code;
+            }
+        }
+
+        // exactly one value must be left for the result
+        if (depth != 1) {
+            offset = strExpr.size();
+            return depth == 0 ? ErrorCode::MissingOperand : ErrorCode::MissingOperator;
+        }
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    template<typename Sink>
+    ErrorCode ArithmeticParser<T>::reduce(Sink& sink, std::size_t& depth, std::size_t& offset)
+    {
+        // get the operator and check it
+        const auto token = m_Ops.top();
+        m_Ops.pop();
+        offset = token.offset;
+
+        if (depth < 2) {
+            switch (token.op) {
+            case OP_INC:
+                // unary plus leaves its operand as it is
+                return depth == 0 ? ErrorCode::MissingOperand : ErrorCode::None;
+            case OP_MIN:
+                return ErrorCode::UnaryMinus;
+            default:
+                return ErrorCode::MissingOperand;
+            }
+        }
+
+        --depth;
+        return sink.applyOperator(token.op, token.offset);
+    }
+
+    template<typename T>
+    constexpr bool ArithmeticParser<T>::isLiteralStart(const char* first, const char* last) noexcept
+    {
+        if (detail::isDigit(*first)) {
+            return true;
+        }
+        // floating point literals may omit the integer part, e.g. ".5"
+        return std::is_floating_point<T>::value && *first == '.' &&
+            last - first > 1 && detail::isDigit(first[1]);
+    }
+
+    template<typename T>
+    ErrorCode ArithmeticParser<T>::parseLiteral(const char*& iter, const char* last, T& value) noexcept
+    {
+        if constexpr (std::is_floating_point<T>::value) {
+            return parseFloating(iter, last, value);
+        }
+        else {
+            return parseInteger(iter, last, value);
+        }
+    }
+
+    template<typename T>
+    ErrorCode ArithmeticParser<T>::parseInteger(const char*& iter, const char* last, T& value) noexcept
+    {
+        std::uint64_t mantissa = 0;
+        auto significant = 0;
+        auto dropped = 0;
+
+        // leading zeros do not count against the digit limit
+        while (iter != last && *iter == '0') {
+            ++iter;
+        }
+        iter = detail::scanDigits(iter, last, mantissa, significant, dropped);
+
+        if (dropped != 0 || (std::numeric_limits<T>::is_specialized &&
+            mantissa > static_cast<std::uint64_t>((std::numeric_limits<T>::max)()))) {
+            return ErrorCode::LiteralTooLarge;
+        }
+        value = static_cast<T>(mantissa);
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    ErrorCode ArithmeticParser<T>::parseFloating(const char*& iter, const char* last, T& value) noexcept
+    {
+        using Limits = detail::FastPathLimits<T>;
+
+        const char* const first = iter;
+        std::uint64_t mantissa = 0;
+        auto significant = 0;
+        auto dropped = 0;
+        auto exponent = 0;
+
+        while (iter != last && *iter == '0') {
+            ++iter;
+        }
+        iter = detail::scanDigits(iter, last, mantissa, significant, dropped);
+
+        // fraction part, every accumulated digit scales the mantissa down by 10
+        if (iter != last && *iter == '.') {
+            ++iter;
+            if (mantissa == 0) {
+                for (; iter != last && *iter == '0'; ++iter) {
+                    --exponent;
+                }
+            }
+            const auto integerDigits = significant;
+            iter = detail::scanDigits(iter, last, mantissa, significant, dropped);
+            exponent -= significant - integerDigits;
+        }
+
+        // exponent part, only taken when at least one digit follows 'e'
+        if (iter != last && (*iter == 'e' || *iter == 'E')) {
+            auto next = iter + 1;
+            const auto negative = next != last && *next == '-';
+            if (next != last && (*next == '+' || *next == '-')) {
+                ++next;
+            }
+            if (next != last && detail::isDigit(*next)) {
+                auto value = 0;
+                for (; next != last && detail::isDigit(*next); ++next) {
+                    if (value < 100000) {
+                        value = value * 10 + (*next - '0');
+                    }
+                }
+                exponent += negative ? -value : value;
+                iter = next;
+            }
+        }
+
+        if (Limits::enabled && dropped == 0) {
+            if (mantissa == 0) {
+                value = T{};
+                return ErrorCode::None;
+            }
+            if (mantissa <= Limits::max_mantissa &&
+                exponent >= -Limits::max_exponent && exponent <= Limits::max_exponent) {
+                const auto power = static_cast<T>(detail::POWERS_OF_TEN[exponent < 0 ? -exponent : exponent]);
+                value = static_cast<T>(mantissa);
+                value = exponent < 0 ? value / power : value * power;
+                return ErrorCode::None;
+            }
+        }
+
+        // slow path, correctly rounded conversion for everything else
+#if defined(__cpp_lib_to_chars)
+        if (std::from_chars(first, iter, value).ec != std::errc{}) {
+            return ErrorCode::LiteralOutOfRange;
+        }
+#else
+        // copy the literal into a buffer for strtod which needs a null-terminated string
+        char literal[64]{};
+        if (iter - first >= static_cast<std::ptrdiff_t>(sizeof(literal))) {
+            return ErrorCode::LiteralOutOfRange;
+        }
+        std::memcpy(literal, first, static_cast<std::size_t>(iter - first));
+        errno = 0;
+        if constexpr (std::is_same<T, float>::value) {
+            value = std::strtof(literal, nullptr);
+        }
+        else if constexpr (std::is_same<T, double>::value) {
+            value = std::strtod(literal, nullptr);
+        }
+        else {
+            value = static_cast<T>(std::strtold(literal, nullptr));
+        }
+        if (errno == ERANGE) {
+            return ErrorCode::LiteralOutOfRange;
+        }
+#endif
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    T CompiledExpression<T>::evaluate() const
+    {
+        return evaluate(nullptr);
+    }
+
+    template<typename T>
+    T CompiledExpression<T>::evaluate(const T* variables) const
+    {
+        return evaluate(variables, EvaluationContext<T>::local());
+    }
+
+    template<typename T>
+    T CompiledExpression<T>::evaluate(const T* variables, EvaluationContext<T>& context) const
+    {
+        T result{};
+        std::size_t offset = 0;
+        const auto code = run(variables, context, result, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+        return result;
+    }
+
+    template<typename T>
+    Result<T> CompiledExpression<T>::tryEvaluate() const noexcept
+    {
+        return tryEvaluate(nullptr);
+    }
+
+    template<typename T>
+    Result<T> CompiledExpression<T>::tryEvaluate(const T* variables) const noexcept
+    {
+        return tryEvaluate(variables, EvaluationContext<T>::local());
+    }
+
+    template<typename T>
+    Result<T> CompiledExpression<T>::tryEvaluate(const T* variables, EvaluationContext<T>& context) const noexcept
+    {
+        try {
+            T result{};
+            std::size_t offset = 0;
+            const auto code = run(variables, context, result, offset);
+            if (code != ErrorCode::None) {
+                return Result<T>{ code, offset };
+            }
+            return Result<T>{ std::move(result) };
+        }
+        catch (const std::bad_alloc&) {
+            return Result<T>{ ErrorCode::OutOfMemory, 0 };
+        }
+    }
+
+    /*
+    *	Handlers of the interpreters are written once for both kinds of dispatch.
+    *	ARITHMETIC_PARSER_OP starts the handler of an opcode and ARITHMETIC_PARSER_NEXT ends it by
+    *	dispatching the instruction after pc. The computed goto version expects a dispatch table
+    *	indexed by opcode - '#' and a done label, the switch version runs inside while (pc != end).
+    */
+#if ARITHMETIC_PARSER_COMPUTED_GOTO
+#define ARITHMETIC_PARSER_OP(label, opcode)   label:
+#define ARITHMETIC_PARSER_DISPATCH()    \
+    goto *dispatch[static_cast<unsigned char>(pc->opcode) - static_cast<unsigned char>(OpCode::Push)]
+#define ARITHMETIC_PARSER_NEXT()    \
+    if (++pc == end) goto done;     \
+    ARITHMETIC_PARSER_DISPATCH()
+#else
+#define ARITHMETIC_PARSER_OP(label, opcode)   case opcode:
+#define ARITHMETIC_PARSER_NEXT()    ++pc; continue
+#endif
+
+    template<typename T>
+    ErrorCode CompiledExpression<T>::run(const T* variables, EvaluationContext<T>& context, T& result, std::size_t& offset) const
+    {
+        if (m_code.empty()) {
+            offset = 0;
+            return ErrorCode::EmptyExpression;
+        }
+        if (variables == nullptr && !m_variables.empty()) {
+            offset = 0;
+            return ErrorCode::UnknownVariable;
+        }
+
+        // a constant expression is folded into a single literal
+        if (m_code.size() == 1 && m_code.front().opcode == OpCode::Push) {
+            result = m_code.front().value;
+            return ErrorCode::None;
+        }
+        if (m_engine == Engine::Register) {
+            return runRegisters(variables, context, result, offset);
+        }
+        if (m_engine == Engine::Closure) {
+            return runClosures(variables, context, result, offset);
+        }
+
+        auto& values = context.m_values;
+        if (values.size() < m_maxDepth) {
+            values.resize(m_maxDepth);
+        }
+        auto& temps = context.m_temps;
+        if (temps.size() < m_tempCount) {
+            temps.resize(m_tempCount);
+        }
+
+        /*
+        *	Each handler works on the raw stack, top points past the topmost value, and ends with
+        *	its own dispatch of the next instruction. With computed goto the jump target comes
+        *	from a table indexed by the opcode character, so every handler has a separate
+        *	indirect branch which the CPU predicts from the handler's own history.
+        *	The switch fallback runs the same handlers.
+        */
+        T* top = values.data();
+        T* const tempData = temps.data();
+        const Instruction<T>* pc = m_bytecode.data();
+        const Instruction<T>* const end = pc + m_bytecode.size();
+
+#if ARITHMETIC_PARSER_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        // indexed by opcode - '#', the range spans Push '#' to StoreTemp '>'
+        static const void* const dispatch[] = {
+            &&op_push, &&op_load, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid,
+            &&op_mul, &&op_add, &&op_invalid, &&op_sub, &&op_invalid, &&op_div, &&op_add_literal,
+            &&op_sub_literal, &&op_mul_literal, &&op_div_literal, &&op_add_variable, &&op_sub_variable,
+            &&op_mul_variable, &&op_mul_add, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid,
+            &&op_load_temp, &&op_invalid, &&op_store_temp
+        };
+        ARITHMETIC_PARSER_DISPATCH();
+#else
+        while (pc != end) {
+            switch (pc->opcode) {
+#endif
+            ARITHMETIC_PARSER_OP(op_push, OpCode::Push)
+                *top++ = pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_load, OpCode::Load)
+                *top++ = variables[pc->operand];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_store_temp, OpCode::StoreTemp)
+                tempData[pc->operand] = top[-1];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_load_temp, OpCode::LoadTemp)
+                *top++ = tempData[pc->operand];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_add, OpCode::Add)
+                --top;
+                top[-1] = top[-1] + top[0];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_sub, OpCode::Sub)
+                --top;
+                top[-1] = top[-1] - top[0];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul, OpCode::Mul)
+                --top;
+                top[-1] = top[-1] * top[0];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_div, OpCode::Div)
+                --top;
+                if (top[0] == 0) {
+                    offset = pc->operand;
+                    return ErrorCode::DivisionByZero;
+                }
+                top[-1] = top[-1] / top[0];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_add_literal, OpCode::AddLiteral)
+                top[-1] = top[-1] + pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_sub_literal, OpCode::SubLiteral)
+                top[-1] = top[-1] - pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul_literal, OpCode::MulLiteral)
+                top[-1] = top[-1] * pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_div_literal, OpCode::DivLiteral)
+                top[-1] = top[-1] / pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_add_variable, OpCode::AddVariable)
+                top[-1] = top[-1] + variables[pc->operand];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_sub_variable, OpCode::SubVariable)
+                top[-1] = top[-1] - variables[pc->operand];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul_variable, OpCode::MulVariable)
+                top[-1] = top[-1] * variables[pc->operand];
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul_add, OpCode::MulAdd)
+            {
+                top -= 2;
+                // the product is rounded on its own, as in the program before fusing
+                const T product = top[0] * top[1];
+                top[-1] = top[-1] + product;
+                ARITHMETIC_PARSER_NEXT();
+            }
+#if ARITHMETIC_PARSER_COMPUTED_GOTO
+        op_invalid:
+            // compile() only emits the opcodes above
+            offset = pc->operand;
+            return ErrorCode::InvalidToken;
+        done:
+#pragma GCC diagnostic pop
+#else
+            default:
+                offset = pc->operand;
+                return ErrorCode::InvalidToken;
+            }
+        }
+#endif
+
+        result = std::move(top[-1]);
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    ErrorCode CompiledExpression<T>::runRegisters(const T* variables, EvaluationContext<T>& context, T& result,
+        std::size_t& offset) const
+    {
+        auto& registers = context.m_values;
+        if (registers.size() < m_registerCount) {
+            registers.resize(m_registerCount);
+        }
+
+        // left-hand literals are copied into their registers once, so every operand is a register,
+        // a variable read in place or part of the instruction
+        T* const file = registers.data();
+        std::copy(m_registerLiterals.cbegin(), m_registerLiterals.cend(), file + m_registerCount - m_registerLiterals.size());
+        // indexed by RegisterOperand, which selects the array without a branch
+        const T* const sources[] = { file, variables };
+#define ARITHMETIC_PARSER_LHS   sources[static_cast<unsigned char>(pc->lhsKind)][pc->lhs]
+#define ARITHMETIC_PARSER_RHS   sources[static_cast<unsigned char>(pc->rhsKind)][pc->rhs]
+
+        const RegisterInstruction<T>* pc = m_registerCode.data();
+        const RegisterInstruction<T>* const end = pc + m_registerCode.size();
+        if (pc == end) {
+            result = sources[static_cast<unsigned char>(m_registerResultKind)][m_registerResult];
+            return ErrorCode::None;
+        }
+
+#if ARITHMETIC_PARSER_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        // indexed by opcode - '#' as in run()
+        static const void* const dispatch[] = {
+            &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid,
+            &&op_mul, &&op_add, &&op_invalid, &&op_sub, &&op_invalid, &&op_div, &&op_add_literal,
+            &&op_sub_literal, &&op_mul_literal, &&op_div_literal, &&op_invalid, &&op_invalid, &&op_invalid,
+            &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid, &&op_move
+        };
+        ARITHMETIC_PARSER_DISPATCH();
+#else
+        while (pc != end) {
+            switch (pc->opcode) {
+#endif
+            ARITHMETIC_PARSER_OP(op_move, OpCode::StoreTemp)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_add, OpCode::Add)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS + ARITHMETIC_PARSER_RHS;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_sub, OpCode::Sub)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS - ARITHMETIC_PARSER_RHS;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul, OpCode::Mul)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS * ARITHMETIC_PARSER_RHS;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_div, OpCode::Div)
+                if (ARITHMETIC_PARSER_RHS == 0) {
+                    offset = pc->offset;
+                    return ErrorCode::DivisionByZero;
+                }
+                file[pc->dst] = ARITHMETIC_PARSER_LHS / ARITHMETIC_PARSER_RHS;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_add_literal, OpCode::AddLiteral)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS + pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_sub_literal, OpCode::SubLiteral)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS - pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_mul_literal, OpCode::MulLiteral)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS * pc->value;
+                ARITHMETIC_PARSER_NEXT();
+            ARITHMETIC_PARSER_OP(op_div_literal, OpCode::DivLiteral)
+                file[pc->dst] = ARITHMETIC_PARSER_LHS / pc->value;
+                ARITHMETIC_PARSER_NEXT();
+#if ARITHMETIC_PARSER_COMPUTED_GOTO
+        op_invalid:
+            offset = pc->offset;
+            return ErrorCode::InvalidToken;
+        done:
+#pragma GCC diagnostic pop
 #else
-#define NODISCARD
-#define INLINE
+            default:
+                offset = pc->offset;
+                return ErrorCode::InvalidToken;
+            }
+        }
 #endif
 
-namespace Parser
-{
-    class ParserException
+        result = sources[static_cast<unsigned char>(m_registerResultKind)][m_registerResult];
+        return ErrorCode::None;
+    }
+
+#undef ARITHMETIC_PARSER_LHS
+#undef ARITHMETIC_PARSER_RHS
+
+#undef ARITHMETIC_PARSER_OP
+#undef ARITHMETIC_PARSER_NEXT
+#undef ARITHMETIC_PARSER_DISPATCH
+
+    template<typename T>
+    ErrorCode CompiledExpression<T>::runClosures(const T* variables, EvaluationContext<T>& context, T& result,
+        std::size_t& offset) const
+    {
+        auto& temps = context.m_temps;
+        if (temps.size() < m_tempCount) {
+            temps.resize(m_tempCount);
+        }
+        detail::ClosureFrame<T> frame{ m_closures.data(), variables, temps.data(), ErrorCode::None, 0 };
+        result = detail::closureChain(m_closures.data() + m_closureRoot, frame);
+        if (frame.error != ErrorCode::None) {
+            offset = frame.offset;
+        }
+        return frame.error;
+    }
+
+    template<typename T>
+    void CompiledExpression<T>::evaluateBatch(const T* const* columns, const std::size_t count, T* out) const
+    {
+        evaluateBatch(columns, count, out, EvaluationContext<T>::local());
+    }
+
+    template<typename T>
+    void CompiledExpression<T>::evaluateBatch(const T* const* columns, const std::size_t count, T* out,
+        EvaluationContext<T>& context) const
+    {
+        std::size_t offset = 0;
+        if (m_code.empty()) {
+            throw ParserException{ ErrorCode::EmptyExpression, offset };
+        }
+        if (columns == nullptr && !m_variables.empty()) {
+            throw ParserException{ ErrorCode::UnknownVariable, offset };
+        }
+
+        // a block per stack entry followed by a block per temporary
+        auto& scratch = context.m_blocks;
+        if (scratch.size() < (m_maxDepth + m_tempCount) * detail::BATCH_BLOCK_SIZE) {
+            scratch.resize((m_maxDepth + m_tempCount) * detail::BATCH_BLOCK_SIZE);
+        }
+        for (std::size_t first = 0; first < count; first += detail::BATCH_BLOCK_SIZE) {
+            const auto rows = (std::min)(detail::BATCH_BLOCK_SIZE, count - first);
+            const auto code = runBlock(columns, first, rows, scratch.data(), out + first, offset);
+            if (code != ErrorCode::None) {
+                throw ParserException{ code, offset };
+            }
+        }
+    }
+
+    template<typename T>
+    ErrorCode CompiledExpression<T>::runBlock(const T* const* columns, const std::size_t first, const std::size_t count,
+        T* scratch, T* out, std::size_t& offset) const
     {
-    public:
-        ParserException() noexcept = default;
-        ParserException(const std::string& err_msg) noexcept : 
-            m_error_msg{ err_msg } 
+        // a column of the block, or a single value shared by all rows
+        struct Operand
         {
-        }
+            const T* column;
+            T scalar;
+        };
 
-        ParserException(std::string&& err_msg) noexcept :
-            m_error_msg{ std::move(err_msg) } 
-        {
+        SmallStack<Operand> operands;
+        SmallStack<Operand> temps;  // temporaries are stored in order, slot i is the i-th entry
+        for (const auto& instruction : m_code) {
+            switch (instruction.opcode) {
+            case OpCode::Push:
+                operands.push(Operand{ nullptr, instruction.value });
+                break;
+            case OpCode::Load:
+                // variables are read straight from the caller's columns
+                operands.push(Operand{ columns[instruction.operand] + first, T{} });
+                break;
+            case OpCode::StoreTemp:
+            {
+                // stack blocks are reused by later operators, keep a copy in the temporary's own block
+                auto temp = operands.top();
+                if (temp.column != nullptr) {
+                    T* const block = scratch + (m_maxDepth + instruction.operand) * detail::BATCH_BLOCK_SIZE;
+                    std::copy(temp.column, temp.column + count, block);
+                    temp.column = block;
+                }
+                temps.push(temp);
+                break;
+            }
+            case OpCode::LoadTemp:
+                operands.push(temps[instruction.operand]);
+                break;
+            default:
+            {
+                const auto rhs = operands.top();
+                operands.pop();
+                auto& lhs = operands.top();
+                const auto op = static_cast<char>(instruction.opcode);
+
+                if (op == '/' && (rhs.column != nullptr ? detail::containsZero(rhs.column, count) : rhs.scalar == 0)) {
+                    offset = instruction.operand;
+                    return ErrorCode::DivisionByZero;
+                }
+
+                if (lhs.column == nullptr && rhs.column == nullptr) {
+                    // literal subexpression, computed once for the block
+                    const auto code = ArithmeticParser<T>::applyOperator(lhs.scalar, rhs.scalar, op);
+                    if (code != ErrorCode::None) {
+                        offset = instruction.operand;
+                        return code;
+                    }
+                }
+                else {
+                    // the result replaces the left operand, so each stack depth owns one scratch block
+                    T* const block = scratch + (operands.size() - 1) * detail::BATCH_BLOCK_SIZE;
+                    detail::applyBlock(op, lhs.column, lhs.scalar, rhs.column, rhs.scalar, block, count);
+                    lhs.column = block;
+                }
+                break;
+            }
+            }
         }
 
-        virtual ~ParserException() = default;
+        const auto& result = operands.top();
+        if (result.column == nullptr) {
+            std::fill(out, out + count, result.scalar);
+        }
+        else {
+            std::copy(result.column, result.column + count, out);
+        }
+        return ErrorCode::None;
+    }
 
+    template<typename T>
+    void CompiledExpression<T>::foldConstants()
+    {
         /*
-        *	Gets an error message for detecting which error occurs.
-        *	returns: Error message.
-        *	exception: This function never throws an exception.
+        *	In postfix order an operator applies to a literal subtree exactly when the two
+        *	instructions before it are literals, so one pass folds them bottom-up in place.
+        *	Operators are only folded one at a time as written, nothing is reassociated
+        *	(e.g. x + 1 + 2 stays as it is) so integer overflow and floating point rounding
+        *	are the same as evaluating the program.
+        *	A division by zero is left in the program and reported on evaluation, with the
+        *	same error and offset as before.
         */
-        NODISCARD virtual const std::string& getErrorMsg() const noexcept
-		{
-            return m_error_msg;
+        std::size_t size = 0;
+        for (const auto& instruction : m_code) {
+            if (instruction.opcode != OpCode::Push && instruction.opcode != OpCode::Load && size >= 2 &&
+                m_code[size - 1].opcode == OpCode::Push && m_code[size - 2].opcode == OpCode::Push) {
+                auto folded = m_code[size - 2].value;
+                if (ArithmeticParser<T>::applyOperator(folded, m_code[size - 1].value,
+                    static_cast<char>(instruction.opcode)) == ErrorCode::None) {
+                    m_code[size - 2].value = std::move(folded);
+                    --size;
+                    continue;
+                }
+            }
+            m_code[size++] = instruction;
         }
+        m_code.resize(size);
+    }
 
-    protected:
-        std::string m_error_msg;
-    };
+    template<typename T>
+    std::uint32_t NodeArena<T>::literal(const T& value)
+    {
+        // room for the literal is made first, so a failed allocation leaves the arena as it was
+        if (m_literals.size() == m_literals.capacity()) {
+            m_literals.reserve((std::max)(m_literals.capacity() * 2, std::size_t{ 16 }));
+        }
+        const auto count = m_nodes.size();
+        const auto index = intern(Node{ OpCode::Push, static_cast<std::uint32_t>(m_literals.size()), none },
+            hash(Node{ OpCode::Push, none, none }, &value), [this, &value](const Node& node) noexcept {
+                if (node.opcode != OpCode::Push) {
+                    return false;
+                }
+                // -0.0 and 0.0 compare equal but are different literals
+                if constexpr (std::is_floating_point<T>::value) {
+                    return m_literals[node.lhs] == value && std::signbit(m_literals[node.lhs]) == std::signbit(value);
+                }
+                else {
+                    return m_literals[node.lhs] == value;
+                }
+            });
+        if (m_nodes.size() != count) {
+            m_literals.push_back(value);
+        }
+        return index;
+    }
 
-	template<typename T>
-	class ArithmeticParser
-	{
-        INLINE static constexpr auto const BRACE_LEFT = '(';
-        INLINE static constexpr auto const BRACE_RIGHT = ')';
-        INLINE static constexpr auto const OP_INC = '+';
-        INLINE static constexpr auto const OP_MIN = '-';
-        INLINE static constexpr auto const OP_MUL = '*';
-        INLINE static constexpr auto const OP_DIV = '/';
+    template<typename T>
+    std::uint32_t NodeArena<T>::variable(const std::uint32_t slot)
+    {
+        const Node candidate{ OpCode::Load, slot, none };
+        return intern(candidate, hash(candidate, nullptr), [slot](const Node& node) noexcept {
+            return node.opcode == OpCode::Load && node.lhs == slot;
+        });
+    }
 
-	public:
-        explicit ArithmeticParser() noexcept = default;	// default constructor
-		explicit ArithmeticParser(std::string) noexcept;
-		virtual ~ArithmeticParser() = default;	// destructor
-		// non-copyable class
-		ArithmeticParser(const ArithmeticParser&) = delete;
-		ArithmeticParser& operator=(const ArithmeticParser&) = delete;
+    template<typename T>
+    std::uint32_t NodeArena<T>::operation(const OpCode opcode, const std::uint32_t lhs, const std::uint32_t rhs)
+    {
+        const Node candidate{ opcode, lhs, rhs };
+        return intern(candidate, hash(candidate, nullptr), [&candidate](const Node& node) noexcept {
+            return node.opcode == candidate.opcode && node.lhs == candidate.lhs && node.rhs == candidate.rhs;
+        });
+    }
 
-        // parse the given expression and evaluate the result.
-        // this function throws an exception if an error occurs.
-        NODISCARD T parseAndEvaluate();
+    template<typename T>
+    void NodeArena<T>::reserve(const std::size_t count)
+    {
+        m_nodes.reserve(count);
+        std::size_t buckets = 16;
+        while (buckets < count * 2) {
+            buckets *= 2;
+        }
+        if (buckets > m_table.size()) {
+            rehash(buckets);
+        }
+    }
 
-        // setter and getter member functions
-		void setExpression(std::string) noexcept;
+    template<typename T>
+    void NodeArena<T>::clear() noexcept
+    {
+        // the table is rebuilt at the size the next program needs
+        m_nodes.clear();
+        m_literals.clear();
+        m_table.clear();
+    }
 
-        NODISCARD std::string getExpression() const noexcept
-		{
-			return m_strEpxr;
-		}
-	protected:
-        // operator priorities
-        int operatorPriority(char) noexcept;
-        // to evaluate result from operands with an operator
-        T callOperator(const T&, const T&, char);
-        //Check an operator is valid or not
-		NODISCARD bool isValidOperator(char op) const noexcept;
-	private:
-		std::stack<char> m_Ops;	// store operators into stack
-		std::stack<T> m_Values;	// store values into stack
-		std::string m_strEpxr;	// string expression for parsing
-	};
+    template<typename T>
+    template<typename Equal>
+    std::uint32_t NodeArena<T>::intern(const Node& candidate, const std::size_t hash, Equal&& equal)
+    {
+        if ((m_nodes.size() + 1) * 2 > m_table.size()) {
+            rehash((std::max)(m_table.size() * 2, std::size_t{ 16 }));
+        }
+        const auto mask = m_table.size() - 1;
+        auto bucket = hash & mask;
+        for (; m_table[bucket] != none; bucket = (bucket + 1) & mask) {
+            if (equal(m_nodes[m_table[bucket]])) {
+                return m_table[bucket];
+            }
+        }
+        m_nodes.push_back(candidate);
+        m_table[bucket] = static_cast<std::uint32_t>(m_nodes.size() - 1);
+        return m_table[bucket];
+    }
 
     template<typename T>
-    ArithmeticParser<T>::ArithmeticParser(std::string strExpr) noexcept :
-        m_strEpxr{ std::move(strExpr) }
+    std::size_t NodeArena<T>::hash(const Node& node, const T* literal) const noexcept
     {
+        std::size_t seed = static_cast<std::size_t>(node.opcode);
+        const auto combine = [&seed](const std::size_t val) noexcept {
+            seed ^= val + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        };
+        switch (node.opcode) {
+        case OpCode::Push:
+            combine(std::hash<T>{}(literal != nullptr ? *literal : m_literals[node.lhs]));
+            break;
+        case OpCode::Load:
+            combine(node.lhs);
+            break;
+        default:
+            combine(node.lhs);
+            combine(node.rhs);
+            break;
+        }
+        return seed;
     }
 
     template<typename T>
-    T ArithmeticParser<T>::parseAndEvaluate()
+    void NodeArena<T>::rehash(const std::size_t buckets)
     {
-        // at first, we should trim the expression as well.
-        m_strEpxr.erase(std::remove_if(m_strEpxr.begin(), m_strEpxr.end(),
-            [](unsigned char ch) {
-                return std::isspace(ch); }
-        ), m_strEpxr.end());
+        m_table.assign(buckets, none);
+        const auto mask = buckets - 1;
+        for (std::uint32_t i = 0; i < m_nodes.size(); i++) {
+            auto bucket = hash(m_nodes[i], nullptr) & mask;
+            while (m_table[bucket] != none) {
+                bucket = (bucket + 1) & mask;
+            }
+            m_table[bucket] = i;
+        }
+    }
 
-        // check if the expression is empty
-        if (m_strEpxr.empty()) {
-			throw ParserException{ "Nothing to do parse!" };
-		}
+    template<typename T>
+    void CompiledExpression<T>::eliminateCommonSubexpressions()
+    {
+        /*
+        *	Every instruction is hash-consed into a DAG node, identical subtrees get the same node.
+        *	The program is then rewritten in its original order: when an operator turns out to be
+        *	a node which was already computed, its whole subtree is dropped and replaced by a load
+        *	of that node's temporary, and the first occurrence of the node stores the temporary.
+        *	Values are computed in the same order as before, so the first error and its offset
+        *	do not change. Literals and variables are never shared, reloading them costs as much.
+        */
+        constexpr auto const none = NodeArena<T>::none;
 
-        // iterate each character into for loop
-        for (auto iter = m_strEpxr.cbegin(); iter != m_strEpxr.cend(); iter++) 
+        // a subtree of the rewritten program, it starts at start and evaluates to node
+        struct Subtree
         {
-            const auto ch = *iter;
+            std::uint32_t node;
+            std::uint32_t start;
+        };
 
-            switch (ch)
-            {
-            case BRACE_LEFT:
-                // Current token is an opening
-                // brace, push it to 'ops'
-                m_Ops.push(ch);
-                break;
-            case BRACE_RIGHT:
-                // Closing brace encountered, solve
-                // entire brace.
-                while (!m_Ops.empty() && m_Ops.top() != BRACE_LEFT) {
-                    T&& val2 = std::move(m_Values.top());
-                    m_Values.pop();
+        // an instruction of the rewritten program, either copied or a reload of a node
+        struct Entry
+        {
+            std::uint32_t index;    // instruction index, or node index of a reload
+            bool reload;
+        };
 
-                    T&& val1 = std::move(m_Values.top());
-                    m_Values.pop();
+        // the arena keeps its memory between programs compiled on the same thread
+        thread_local NodeArena<T> nodes;
+        nodes.clear();
+        nodes.reserve(m_code.size());
 
-                    const auto op = m_Ops.top();
-                    m_Values.push(callOperator(val1, val2, op));
-                    m_Ops.pop();
-                }
+        // first pass, find the node of each instruction and the instructions which are kept
+        std::vector<std::uint32_t> nodeOf(m_code.size());
+        std::vector<Entry> kept;
+        kept.reserve(m_code.size());
+        SmallStack<Subtree> subtrees;
+        auto reused = false;
 
-                // if we find a right parenthesis when the stack is empty
-                if (m_Ops.empty()) {
-					throw ParserException{ "unbalanced parentheses!" };
-				}
-				m_Ops.pop();    // pop opening brace.
-                break;
+        for (std::uint32_t i = 0; i < m_code.size(); i++) {
+            const auto& instruction = m_code[i];
+            const auto start = static_cast<std::uint32_t>(kept.size());
+            if (instruction.opcode == OpCode::Push || instruction.opcode == OpCode::Load) {
+                nodeOf[i] = instruction.opcode == OpCode::Push ? nodes.literal(instruction.value) : nodes.variable(instruction.operand);
+                kept.push_back(Entry{ i, false });
+                subtrees.push(Subtree{ nodeOf[i], start });
+                continue;
+            }
+
+            const auto rhs = subtrees.top();
+            subtrees.pop();
+            const auto lhs = subtrees.top();
+            subtrees.pop();
+
+            const auto count = nodes.size();
+            nodeOf[i] = nodes.operation(instruction.opcode, lhs.node, rhs.node);
+            if (nodes.size() == count) {
+                // computed before, drop the subtree
+                kept.resize(lhs.start);
+                kept.push_back(Entry{ nodeOf[i], true });
+                reused = true;
+            }
+            else {
+                kept.push_back(Entry{ i, false });
+            }
+            subtrees.push(Subtree{ nodeOf[i], lhs.start });
+        }
+
+        if (!reused) {
+            return;
+        }
+
+        // only reloads which survived the first pass need a temporary,
+        // a reload inside a dropped subtree was dropped with it
+        std::vector<bool> shared(nodes.size());
+        for (const auto& entry : kept) {
+            if (entry.reload) {
+                shared[entry.index] = true;
+            }
+        }
+
+        // second pass, store each shared node right after its first computation,
+        // temporaries are numbered in the order they are stored
+        std::vector<std::uint32_t> tempOf(nodes.size(), none);
+        std::vector<Instruction<T>> code;
+        code.reserve(kept.size() * 2);
+        std::uint32_t temps = 0;
+        for (const auto& entry : kept) {
+            if (entry.reload) {
+                code.push_back(Instruction<T>{ OpCode::LoadTemp, tempOf[entry.index], T{} });
+                continue;
+            }
+
+            code.push_back(m_code[entry.index]);
+            const auto node = nodeOf[entry.index];
+            if (shared[node] && tempOf[node] == none) {
+                tempOf[node] = temps++;
+                code.push_back(Instruction<T>{ OpCode::StoreTemp, tempOf[node], T{} });
+            }
+        }
 
+        m_code = std::move(code);
+        m_tempCount = temps;
+    }
+
+    template<typename T>
+    void CompiledExpression<T>::updateDepth() noexcept
+    {
+        std::size_t depth = 0;
+        m_maxDepth = 0;
+        for (const auto& instruction : m_code) {
+            switch (instruction.opcode) {
+            case OpCode::Push:
+            case OpCode::Load:
+            case OpCode::LoadTemp:
+                m_maxDepth = (std::max)(m_maxDepth, ++depth);
+                break;
+            case OpCode::StoreTemp:
+                break;
             default:
-                /*  
-                * From cppreference.com:
-                * isdigit and isxdigit are the only standard narrow character classification functions 
-                * that are not affected by the currently installed C locale. although some implementations 
-                * (e.g. Microsoft in 1252 codepage) may classify additional single-byte characters as digits.
-                * Like all other functions from <cctype>, the behavior of std::isdigit is undefined 
-                * if the argument's value is neither representable as unsigned char nor equal to EOF. 
-                * To use these functions safely with plain chars (or signed chars), 
-                * the argument should first be converted to unsigned char:
-                */
-
-                // Current token is a number, push
-                // it to stack for numbers.
-                if (std::isdigit(static_cast<unsigned char>(ch)) != 0) {
-                    // get the current value of digit number
-                    T val = ch - '0';
-
-                    // If there may be more digit, throw an exception
-                    for (auto next_iter = iter + 1; next_iter != m_strEpxr.cend() &&
-                        std::isdigit(static_cast<unsigned char>(*next_iter)) != 0; next_iter++) {
-                        throw ParserException("Literal is too large!");
-                    }
+                --depth;
+                break;
+            }
+        }
+    }
 
-                    m_Values.push(val);
+    template<typename T>
+    void CompiledExpression<T>::fuseInstructions()
+    {
+        /*
+        *	A literal or variable right before an operator is its right operand, and a
+        *	multiplication right before an addition is the addition's right operand, so each
+        *	pair can run as one instruction which neither pushes nor pops the operand.
+        *	Pairs are merged greedily from the left, the stack depth never grows.
+        *	A division by a variable is kept apart since its zero check needs the offset of the
+        *	operator as well as the slot, and a division by a zero literal stays an error on evaluation.
+        */
+        m_bytecode.clear();
+        m_bytecode.reserve(m_code.size());
+        for (std::size_t i = 0; i < m_code.size(); i++) {
+            const auto& instruction = m_code[i];
+            const auto next = i + 1 < m_code.size() ? m_code[i + 1].opcode : instruction.opcode;
+            const auto binary = next == OpCode::Add || next == OpCode::Sub || next == OpCode::Mul || next == OpCode::Div;
+            if (i + 1 < m_code.size() && binary) {
+                if (instruction.opcode == OpCode::Push && (next != OpCode::Div || instruction.value != 0)) {
+                    const auto fused = next == OpCode::Add ? OpCode::AddLiteral : next == OpCode::Sub ? OpCode::SubLiteral :
+                        next == OpCode::Mul ? OpCode::MulLiteral : OpCode::DivLiteral;
+                    m_bytecode.push_back(Instruction<T>{ fused, m_code[i + 1].operand, instruction.value });
+                    ++i;
+                    continue;
                 }
-                // Current token is an operator.
-                else
-                {
-                    // While top of 'ops' has same or greater
-                    // precedence to current token, which
-                    // is an operator. Apply operator on top
-                    // of 'ops' to top two elements in values stack.
-                    while (!m_Ops.empty() && operatorPriority(m_Ops.top())
-                        >= operatorPriority(ch)) {
-
-                        const auto op = m_Ops.top();
-
-                        T&& val2 = std::move(m_Values.top());
-                        m_Values.pop();
-
-                        if (m_Values.empty()) {
-                            switch (op) {
-                            case OP_INC:
-                                m_Values.push(val2);
-                                break;
-                            case OP_MIN:
-                                throw ParserException{ "negative literal or unary minus" };
-                                break;
-                            case OP_MUL:
-                            case OP_DIV:
-                                throw ParserException{ "missing operand" };
-                                break;
-                            }
-                        }
-                        else {
-                            T&& val1 = std::move(m_Values.top());
-                            m_Values.pop();
-
-                            m_Values.push(callOperator(val1, val2, op));
-                        }
-
-                        m_Ops.pop();
-                    }
-
-                    // Push current token to 'ops'.
-                    if (isValidOperator(ch)) {
-						m_Ops.push(ch);
-					}
-                    else {
-						throw ParserException{ "Invalid token." };
-					}
+                if (instruction.opcode == OpCode::Load && next != OpCode::Div) {
+                    const auto fused = next == OpCode::Add ? OpCode::AddVariable : next == OpCode::Sub ? OpCode::SubVariable :
+                        OpCode::MulVariable;
+                    m_bytecode.push_back(Instruction<T>{ fused, instruction.operand, T{} });
+                    ++i;
+                    continue;
+                }
+                if (instruction.opcode == OpCode::Mul && next == OpCode::Add) {
+                    m_bytecode.push_back(Instruction<T>{ OpCode::MulAdd, instruction.operand, T{} });
+                    ++i;
+                    continue;
                 }
-                break;
             }
+            m_bytecode.push_back(instruction);
         }
+    }
 
-        // Entire expression has been parsed at this
-        // point, apply remaining ops to remaining
-        // values.
-        while (!m_Ops.empty()) {
-            
-            // get the operator and check it
-            const auto op = m_Ops.top();
+    template<typename T>
+    std::size_t CompiledExpression<T>::memoryUsage() const noexcept
+    {
+        auto bytes = (m_code.capacity() + m_bytecode.capacity()) * sizeof(Instruction<T>) +
+            m_registerCode.capacity() * sizeof(RegisterInstruction<T>) +
+            m_registerLiterals.capacity() * sizeof(T) +
+            m_closures.capacity() * sizeof(detail::ClosureNode<T>) +
+            m_variables.capacity() * sizeof(std::string);
+        for (const auto& name : m_variables) {
+            bytes += name.capacity();
+        }
+        return bytes;
+    }
 
-            // if there is still a left parenthesis at the top of the stack
-            if (op == BRACE_LEFT) {
-				throw ParserException{"unbalanced parentheses!"};
-			}
+    template<typename T>
+    void CompiledExpression<T>::setEngine(const Engine engine)
+    {
+        if (engine == Engine::Register && m_registerCode.empty()) {
+            allocateRegisters();
+        }
+        if (engine == Engine::Closure && m_closures.empty() && !buildClosures()) {
+            return;
+        }
+        m_engine = engine;
+    }
 
-            T&& val2 = std::move(m_Values.top());
-            m_Values.pop();
+    template<typename T>
+    bool CompiledExpression<T>::buildClosures()
+    {
+        /*
+        *	Literals, variables and temporaries become operands of the node using them, only
+        *	operators (and stores of shared subexpressions) are nodes. An operator whose left
+        *	operand is a subtree extends the chain of that subtree, the recursion of an
+        *	evaluation is only as deep as chains nest as right operands, which is bounded here.
+        */
+        struct Chain
+        {
+            std::vector<detail::ClosureNode<T>> nodes;
+            std::size_t depth;  // nesting of chains as right operands, 1 if there is none
+        };
+        struct Operand
+        {
+            detail::ClosureOperand kind;
+            std::uint32_t index;    // chain index for ClosureOperand::Chain
+            T value;
+        };
 
-            if (m_Values.empty()) {
-                switch (op) {
-                case OP_INC:
-                    m_Values.push(val2);
-                    break;
-                case OP_MIN:
-                    throw ParserException{ "negative literal or unary minus" };
-                    break;
-                case OP_MUL:
-                case OP_DIV:
-                    throw ParserException{ "missing operand" };
-                    break;
+        if (m_code.empty()) {
+            return false;
+        }
+        std::vector<Chain> chains;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> links;    // chain and node whose rhs is a chain index
+        std::vector<Operand> operands;
+        operands.reserve(m_maxDepth);
+        const auto startChain = [&chains, &operands](const detail::ClosureNode<T>& node, const std::size_t depth) {
+            chains.push_back(Chain{ { node }, depth });
+            operands.push_back(Operand{ detail::ClosureOperand::Chain, static_cast<std::uint32_t>(chains.size() - 1), T{} });
+        };
+
+        for (const auto& instruction : m_code) {
+            switch (instruction.opcode) {
+            case OpCode::Push:
+                operands.push_back(Operand{ detail::ClosureOperand::Literal, 0, instruction.value });
+                break;
+            case OpCode::Load:
+                operands.push_back(Operand{ detail::ClosureOperand::Variable, instruction.operand, T{} });
+                break;
+            case OpCode::LoadTemp:
+                operands.push_back(Operand{ detail::ClosureOperand::Temp, instruction.operand, T{} });
+                break;
+            case OpCode::StoreTemp:
+                // only operators are shared, so the value is always a chain
+                chains[operands.back().index].nodes.push_back(detail::ClosureNode<T>{ &detail::closureStore<T>,
+                    0, instruction.operand, 0, 0, T{}, T{} });
+                break;
+            default:
+            {
+                const auto rhs = operands.back();
+                operands.pop_back();
+                const auto lhs = operands.back();
+                operands.pop_back();
+                const auto chained = lhs.kind == detail::ClosureOperand::Chain;
+                const auto nested = rhs.kind == detail::ClosureOperand::Chain ? chains[rhs.index].depth + 1 : 1;
+                const auto node = detail::ClosureNode<T>{
+                    detail::closureFunction<T>(instruction.opcode, chained ? detail::ClosureOperand::Accumulator : lhs.kind, rhs.kind),
+                    lhs.index, rhs.index, instruction.operand, 0, lhs.value, rhs.value };
+                if (nested > ARITHMETIC_PARSER_CLOSURE_DEPTH) {
+                    return false;
+                }
+                if (chained) {
+                    auto& chain = chains[lhs.index];
+                    chain.nodes.push_back(node);
+                    chain.depth = (std::max)(chain.depth, nested);
+                    operands.push_back(lhs);
+                }
+                else {
+                    startChain(node, nested);
+                }
+                if (rhs.kind == detail::ClosureOperand::Chain) {
+                    links.emplace_back(operands.back().index, static_cast<std::uint32_t>(chains[operands.back().index].nodes.size() - 1));
                 }
+                break;
             }
-            else {
-                T&& val1 = std::move(m_Values.top());
-                m_Values.pop();
-
-                m_Values.push(callOperator(val1, val2, op));
             }
+        }
+        if (operands.back().kind == detail::ClosureOperand::Variable) {
+            startChain(detail::ClosureNode<T>{ &detail::closureVariable<T>, operands.back().index, 0, 0, 0, T{}, T{} }, 1);
+        }
+        // a folded literal needs no nodes, run() returns it directly
+        if (operands.back().kind != detail::ClosureOperand::Chain) {
+            m_closures.clear();
+            return true;
+        }
 
-            m_Ops.pop();
+        // lay the chains out one after the other and turn chain indices into node indices
+        std::vector<std::uint32_t> first(chains.size());
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < chains.size(); i++) {
+            first[i] = static_cast<std::uint32_t>(count);
+            chains[i].nodes.front().steps = static_cast<std::uint32_t>(chains[i].nodes.size() - 1);
+            count += chains[i].nodes.size();
+        }
+        for (const auto& link : links) {
+            auto& node = chains[link.first].nodes[link.second];
+            node.rhs = first[node.rhs];
         }
+        m_closures.clear();
+        m_closures.reserve(count);
+        for (const auto& chain : chains) {
+            m_closures.insert(m_closures.end(), chain.nodes.cbegin(), chain.nodes.cend());
+        }
+        m_closureRoot = first[operands.back().index];
+        return true;
+    }
 
-        // Top of 'values' contains result, return it.
-        return m_Values.top();
+    template<typename T>
+    void CompiledExpression<T>::allocateRegisters()
+    {
+        /*
+        *	The register file holds a register per stack slot, one per temporary and then the literals
+        *	which are not a right operand. Loading a value is not an instruction, the operator reading
+        *	it refers to its register or variable slot or takes a right-hand literal as an immediate,
+        *	so only operators (and copies into temporaries) are left.
+        *	An operator writes to the register of the stack slot its result would take.
+        */
+        struct Operand
+        {
+            std::uint32_t index;    // register or variable slot, or literal index for a pending literal
+            bool literal;           // a literal which has no register yet
+            RegisterOperand kind;
+        };
+
+        const auto tempBase = static_cast<std::uint32_t>(m_maxDepth);
+        const auto literalBase = tempBase + static_cast<std::uint32_t>(m_tempCount);
+        m_registerLiterals.clear();
+        m_registerCode.clear();
+
+        // a literal gets a register when it is needed as a left operand or a temporary
+        const auto materialize = [this, literalBase](Operand& operand) {
+            if (operand.literal) {
+                operand.literal = false;
+                m_registerLiterals.push_back(m_code[operand.index].value);
+                operand.index = literalBase + static_cast<std::uint32_t>(m_registerLiterals.size() - 1);
+            }
+        };
+
+        std::vector<Operand> operands;
+        operands.reserve(m_maxDepth);
+        for (std::size_t i = 0; i < m_code.size(); i++) {
+            const auto& instruction = m_code[i];
+            switch (instruction.opcode) {
+            case OpCode::Push:
+                operands.push_back(Operand{ static_cast<std::uint32_t>(i), true, RegisterOperand::Register });
+                break;
+            case OpCode::Load:
+                operands.push_back(Operand{ instruction.operand, false, RegisterOperand::Variable });
+                break;
+            case OpCode::LoadTemp:
+                operands.push_back(Operand{ tempBase + instruction.operand, false, RegisterOperand::Register });
+                break;
+            case OpCode::StoreTemp:
+            {
+                // the operator computing the value writes straight into the temporary
+                const auto temp = tempBase + instruction.operand;
+                auto& value = operands.back();
+                if (!value.literal && value.kind == RegisterOperand::Register && !m_registerCode.empty() &&
+                    value.index == m_registerCode.back().dst) {
+                    m_registerCode.back().dst = temp;
+                }
+                else {
+                    materialize(value);
+                    m_registerCode.push_back(RegisterInstruction<T>{ OpCode::StoreTemp, value.kind, RegisterOperand::Register,
+                        temp, value.index, 0, instruction.operand, T{} });
+                }
+                value = Operand{ temp, false, RegisterOperand::Register };
+                break;
+            }
+            default:
+            {
+                const auto rhs = operands.back();
+                operands.pop_back();
+                auto& lhs = operands.back();
+                materialize(lhs);
+                const auto dst = static_cast<std::uint32_t>(operands.size() - 1);
+                auto fused = RegisterInstruction<T>{ instruction.opcode, lhs.kind, rhs.kind, dst, lhs.index, rhs.index,
+                    instruction.operand, T{} };
+                // a division by a zero literal stays a division, it fails when evaluated
+                if (rhs.literal && (instruction.opcode != OpCode::Div || m_code[rhs.index].value != 0)) {
+                    fused.opcode = instruction.opcode == OpCode::Add ? OpCode::AddLiteral :
+                        instruction.opcode == OpCode::Sub ? OpCode::SubLiteral :
+                        instruction.opcode == OpCode::Mul ? OpCode::MulLiteral : OpCode::DivLiteral;
+                    fused.value = m_code[rhs.index].value;
+                }
+                else {
+                    auto right = rhs;
+                    materialize(right);
+                    fused.rhs = right.index;
+                    fused.rhsKind = right.kind;
+                }
+                m_registerCode.push_back(fused);
+                lhs = Operand{ dst, false, RegisterOperand::Register };
+                break;
+            }
+            }
+        }
+        if (!operands.empty()) {
+            materialize(operands.back());
+            m_registerResult = operands.back().index;
+            m_registerResultKind = operands.back().kind;
+        }
+        m_registerCount = literalBase + m_registerLiterals.size();
     }
 
     template<typename T>
@@ -298,7 +2684,7 @@ namespace Parser
     }
 
     template<typename T>
-    int ArithmeticParser<T>::operatorPriority(const char op) noexcept
+    constexpr int ArithmeticParser<T>::operatorPriority(const char op) noexcept
     {
         switch (op) {
         case OP_INC:
@@ -313,22 +2699,37 @@ namespace Parser
     }
 
     template<typename T>
-    T ArithmeticParser<T>::callOperator(const T& val1, const T& val2, const char op)
+    constexpr T ArithmeticParser<T>::callOperator(const T& val1, const T& val2, const char op)
+    {
+        T result = val1;
+        const auto code = applyOperator(result, val2, op);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, 0 };
+        }
+        return result;
+    }
+
+    template<typename T>
+    constexpr ErrorCode ArithmeticParser<T>::applyOperator(T& val1, const T& val2, const char op) noexcept
     {
         switch (op) {
         case OP_INC:
-            return val1 + val2;
+            val1 = val1 + val2;
+            break;
         case OP_MIN:
-            return val1 - val2;
+            val1 = val1 - val2;
+            break;
         case OP_MUL:
-            return val1 * val2;
+            val1 = val1 * val2;
+            break;
         case OP_DIV:
             if (val2 == 0) {
-                throw ParserException{ "cannot divide by zero" };
+                return ErrorCode::DivisionByZero;
             }
-            return val1 / val2;
+            val1 = val1 / val2;
+            break;
         }
-        return 0;
+        return ErrorCode::None;
     }
 
     template<typename T>
@@ -0,0 +1,316 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Coroutine interface for evaluating expressions on a thread pool, C++20 only.
+//  Concurrent requests for the same expression are evaluated together in one batch.
+
+#ifndef ARITHMETIC_PARSER_ASYNC_EVALUATION
+#define ARITHMETIC_PARSER_ASYNC_EVALUATION
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ArithmeticParser.h"
+#include "ExpressionCache.h"
+#include "ThreadPool.h"
+
+// <coroutine> refuses to compile unless the compiler supports coroutines
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>) && __has_include(<span>)
+#include <coroutine>
+#include <span>
+#endif
+#endif
+
+#if defined(__cpp_lib_coroutine) && defined(__cpp_lib_span)
+
+namespace Parser
+{
+    // counters of an AsyncEvaluator
+    struct AsyncStatistics
+    {
+        std::uint64_t requests;     // requests which were queued, malformed expressions are not
+        std::uint64_t batches;      // passes over the queued requests, each for one expression
+    };
+
+    /*
+    *	Evaluates expressions for coroutines: co_await evaluator.evaluateAsync(expr, variables)
+    *	suspends the calling coroutine, evaluates on the pool and resumes it on a worker with the result.
+    *	Expressions are compiled through an ExpressionCache. Requests for the same compiled program
+    *	are queued together, and one task evaluates everything which was queued before it started,
+    *	with a single evaluateBatch pass. So callers of a popular formula share the work, the more
+    *	of them wait the larger the batches get. A lone request is evaluated on its own.
+    *	The coroutines must not let exceptions escape when they are resumed, like any pool task.
+    */
+    template<typename T>
+    class AsyncEvaluator
+    {
+    public:
+        using Program = typename ExpressionCache<T>::Program;
+
+        // result of evaluateAsync, to be awaited at once
+        class Awaiter
+        {
+        public:
+            // a malformed expression or missing variables complete without suspending
+            bool await_ready() const noexcept
+            {
+                return m_evaluator == nullptr;
+            }
+
+            bool await_suspend(const std::coroutine_handle<> handle) noexcept
+            {
+                m_handle = handle;
+                return m_evaluator->enqueue(*this);
+            }
+
+            Result<T> await_resume() noexcept
+            {
+                return std::move(m_result);
+            }
+
+        private:
+            friend class AsyncEvaluator;
+
+            Awaiter(Result<T> result) noexcept :
+                m_result{ std::move(result) }
+            {
+            }
+
+            Awaiter(AsyncEvaluator* evaluator, Program program, const std::span<const T> variables) noexcept :
+                m_evaluator{ evaluator },
+                m_program{ std::move(program) },
+                m_variables{ variables }
+            {
+            }
+
+            AsyncEvaluator* m_evaluator{};
+            Program m_program;
+            std::span<const T> m_variables;
+            Result<T> m_result;
+            std::coroutine_handle<> m_handle;
+            Awaiter* m_next{};  // next request of the same batch
+        };
+
+        // threads == 0 uses one thread per hardware thread
+        explicit AsyncEvaluator(std::size_t threads = 0);
+        // evaluate on a pool shared with other work, which must outlive the evaluator
+        explicit AsyncEvaluator(ThreadPool& pool);
+        // finishes the queued requests
+        ~AsyncEvaluator();
+        // non-copyable class
+        AsyncEvaluator(const AsyncEvaluator&) = delete;
+        AsyncEvaluator& operator=(const AsyncEvaluator&) = delete;
+
+        /*
+        *	Awaitable result of the expression with the given variable values, indexed by slot
+        *	like for CompiledExpression::evaluate. The expression is compiled or looked up here,
+        *	the variables are read on the pool and must stay valid until the coroutine resumes.
+        *	Errors are reported in the result as by tryEvaluate.
+        */
+        NODISCARD Awaiter evaluateAsync(std::string_view strExpr, std::span<const T> variables = {});
+        // same for a program compiled beforehand, which skips the cache lookup
+        NODISCARD Awaiter evaluateAsync(Program program, std::span<const T> variables = {});
+
+        NODISCARD AsyncStatistics statistics() const noexcept
+        {
+            return AsyncStatistics{ m_requestCount.load(std::memory_order_relaxed), m_batchCount.load(std::memory_order_relaxed) };
+        }
+
+    private:
+        // requests for one program which wait for their batch
+        struct Batch
+        {
+            Program program;
+            Awaiter* first{};   // the requests are linked through their awaiters, latest first
+            std::size_t count{};
+        };
+
+        // queue a request, false if it could not be queued and is already complete
+        bool enqueue(Awaiter& request) noexcept;
+        // evaluate and resume the requests queued for program, runs on the pool
+        void flush(const CompiledExpression<T>* program) noexcept;
+        static void evaluate(const Batch& batch);
+
+        ExpressionCache<T> m_cache;
+        std::mutex m_mutex;
+        std::unordered_map<const CompiledExpression<T>*, Batch> m_batches;	// a batch is removed when it is flushed
+        std::atomic<std::uint64_t> m_requestCount{};
+        std::atomic<std::uint64_t> m_batchCount{};
+        std::unique_ptr<ThreadPool> m_ownPool;
+        ThreadPool& m_pool;
+    };
+
+    template<typename T>
+    AsyncEvaluator<T>::AsyncEvaluator(const std::size_t threads) :
+        m_ownPool{ std::make_unique<ThreadPool>(threads) },
+        m_pool{ *m_ownPool }
+    {
+    }
+
+    template<typename T>
+    AsyncEvaluator<T>::AsyncEvaluator(ThreadPool& pool) :
+        m_pool{ pool }
+    {
+    }
+
+    template<typename T>
+    AsyncEvaluator<T>::~AsyncEvaluator()
+    {
+        // the pool finishes the queued batches while the members they use still exist.
+        // a shared pool is not waited for, its requests must have resumed by now.
+        m_ownPool.reset();
+    }
+
+    template<typename T>
+    typename AsyncEvaluator<T>::Awaiter AsyncEvaluator<T>::evaluateAsync(const std::string_view strExpr, const std::span<const T> variables)
+    {
+        auto program = m_cache.tryGet(strExpr);
+        if (!program) {
+            return Awaiter{ Result<T>{ program.error(), program.offset() } };
+        }
+        return evaluateAsync(program.value(), variables);
+    }
+
+    template<typename T>
+    typename AsyncEvaluator<T>::Awaiter AsyncEvaluator<T>::evaluateAsync(Program program, const std::span<const T> variables)
+    {
+        if (variables.size() < program->variableCount()) {
+            // reported the same way as evaluating without variables
+            return Awaiter{ program->tryEvaluate() };
+        }
+        return Awaiter{ this, std::move(program), variables };
+    }
+
+    template<typename T>
+    bool AsyncEvaluator<T>::enqueue(Awaiter& request) noexcept
+    {
+        try {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            auto& batch = m_batches[request.m_program.get()];
+            if (batch.count == 0) {
+                // the first request of a batch schedules it, the others join until it runs
+                batch.program = request.m_program;
+                try {
+                    m_pool.submit([this, key = request.m_program.get()] { flush(key); });
+                }
+                catch (...) {
+                    m_batches.erase(request.m_program.get());
+                    throw;
+                }
+            }
+            request.m_next = batch.first;
+            batch.first = &request;
+            batch.count++;
+            // counted before the request can complete
+            m_requestCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (const std::bad_alloc&) {
+            request.m_result = Result<T>{ ErrorCode::OutOfMemory, 0 };
+            return false;
+        }
+        catch (const std::system_error&) {
+            // the mutex could not be locked
+            request.m_result = Result<T>{ ErrorCode::OutOfMemory, 0 };
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    void AsyncEvaluator<T>::flush(const CompiledExpression<T>* const program) noexcept
+    {
+        Batch batch;
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            const auto iter = m_batches.find(program);
+            batch = std::move(iter->second);
+            m_batches.erase(iter);
+        }
+        m_batchCount.fetch_add(1, std::memory_order_relaxed);
+
+        try {
+            evaluate(batch);
+        }
+        catch (const std::bad_alloc&) {
+            for (auto request = batch.first; request != nullptr; request = request->m_next) {
+                request->m_result = Result<T>{ ErrorCode::OutOfMemory, 0 };
+            }
+        }
+        // a resumed coroutine may destroy its awaiter, so nothing is read from it afterwards
+        for (auto request = batch.first; request != nullptr;) {
+            const auto handle = request->m_handle;
+            request = request->m_next;
+            handle.resume();
+        }
+    }
+
+    template<typename T>
+    void AsyncEvaluator<T>::evaluate(const Batch& batch)
+    {
+        const auto& program = *batch.program;
+        if (batch.count == 1) {
+            batch.first->m_result = program.tryEvaluate(batch.first->m_variables.data());
+            return;
+        }
+
+        // one column per variable slot, one row per request
+        thread_local std::vector<T> values;
+        thread_local std::vector<const T*> columns;
+        thread_local std::vector<T> out;
+        const auto rows = batch.count;
+        const auto slots = program.variableCount();
+        values.resize(slots * rows);
+        columns.resize(slots);
+        out.resize(rows);
+        for (std::size_t slot = 0; slot < slots; slot++) {
+            columns[slot] = values.data() + slot * rows;
+        }
+        std::size_t row = 0;
+        for (auto request = batch.first; request != nullptr; request = request->m_next, row++) {
+            for (std::size_t slot = 0; slot < slots; slot++) {
+                values[slot * rows + row] = request->m_variables[slot];
+            }
+        }
+
+        try {
+            program.evaluateBatch(columns.data(), rows, out.data());
+            row = 0;
+            for (auto request = batch.first; request != nullptr; request = request->m_next) {
+                request->m_result = Result<T>{ out[row++] };
+            }
+        }
+        catch (const ParserException&) {
+            // some row divides by zero, every request gets its own result and error
+            for (auto request = batch.first; request != nullptr; request = request->m_next) {
+                request->m_result = program.tryEvaluate(request->m_variables.data());
+            }
+        }
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,357 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Column kernels used by CompiledExpression<T>::evaluateBatch.
+//  Each kernel applies one operator to a whole block of rows, with AVX/AVX2 or SSE
+//  intrinsics when the target supports them and a plain loop otherwise.
+
+#ifndef ARITHMETIC_PARSER_BATCH_KERNELS
+#define ARITHMETIC_PARSER_BATCH_KERNELS
+
+#include <cstddef>
+
+#include "ParserConfig.h"
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define ARITHMETIC_PARSER_SIMD_INT  2
+#elif defined(__SSE4_1__)
+#define ARITHMETIC_PARSER_SIMD_INT  1
+#else
+#define ARITHMETIC_PARSER_SIMD_INT  0
+#endif
+
+namespace Parser
+{
+    namespace detail
+    {
+        // number of rows evaluated together, each intermediate result needs a block of this size
+        INLINE constexpr std::size_t const BATCH_BLOCK_SIZE = 256;
+
+        template<char Op, typename T>
+        inline T applyScalar(const T val1, const T val2) noexcept
+        {
+            if constexpr (Op == '+') {
+                return val1 + val2;
+            }
+            else if constexpr (Op == '-') {
+                return val1 - val2;
+            }
+            else if constexpr (Op == '*') {
+                return val1 * val2;
+            }
+            else {
+                return val1 / val2;
+            }
+        }
+
+        // vector operations of a type, width 1 means there is no vector support
+        template<typename T>
+        struct SimdTraits
+        {
+            INLINE static constexpr std::size_t const width = 1;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return false;
+            }
+        };
+
+#if defined(__AVX__)
+        template<>
+        struct SimdTraits<double>
+        {
+            using Vec = __m256d;
+            INLINE static constexpr std::size_t const width = 4;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return true;
+            }
+
+            static Vec load(const double* ptr) noexcept { return _mm256_loadu_pd(ptr); }
+            static void store(double* ptr, const Vec val) noexcept { _mm256_storeu_pd(ptr, val); }
+            static Vec broadcast(const double val) noexcept { return _mm256_set1_pd(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm256_add_pd(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm256_sub_pd(val1, val2);
+                }
+                else if constexpr (Op == '*') {
+                    return _mm256_mul_pd(val1, val2);
+                }
+                else {
+                    return _mm256_div_pd(val1, val2);
+                }
+            }
+        };
+
+        template<>
+        struct SimdTraits<float>
+        {
+            using Vec = __m256;
+            INLINE static constexpr std::size_t const width = 8;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return true;
+            }
+
+            static Vec load(const float* ptr) noexcept { return _mm256_loadu_ps(ptr); }
+            static void store(float* ptr, const Vec val) noexcept { _mm256_storeu_ps(ptr, val); }
+            static Vec broadcast(const float val) noexcept { return _mm256_set1_ps(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm256_add_ps(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm256_sub_ps(val1, val2);
+                }
+                else if constexpr (Op == '*') {
+                    return _mm256_mul_ps(val1, val2);
+                }
+                else {
+                    return _mm256_div_ps(val1, val2);
+                }
+            }
+        };
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        template<>
+        struct SimdTraits<double>
+        {
+            using Vec = __m128d;
+            INLINE static constexpr std::size_t const width = 2;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return true;
+            }
+
+            static Vec load(const double* ptr) noexcept { return _mm_loadu_pd(ptr); }
+            static void store(double* ptr, const Vec val) noexcept { _mm_storeu_pd(ptr, val); }
+            static Vec broadcast(const double val) noexcept { return _mm_set1_pd(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm_add_pd(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm_sub_pd(val1, val2);
+                }
+                else if constexpr (Op == '*') {
+                    return _mm_mul_pd(val1, val2);
+                }
+                else {
+                    return _mm_div_pd(val1, val2);
+                }
+            }
+        };
+
+        template<>
+        struct SimdTraits<float>
+        {
+            using Vec = __m128;
+            INLINE static constexpr std::size_t const width = 4;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return true;
+            }
+
+            static Vec load(const float* ptr) noexcept { return _mm_loadu_ps(ptr); }
+            static void store(float* ptr, const Vec val) noexcept { _mm_storeu_ps(ptr, val); }
+            static Vec broadcast(const float val) noexcept { return _mm_set1_ps(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm_add_ps(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm_sub_ps(val1, val2);
+                }
+                else if constexpr (Op == '*') {
+                    return _mm_mul_ps(val1, val2);
+                }
+                else {
+                    return _mm_div_ps(val1, val2);
+                }
+            }
+        };
+#endif
+
+#if ARITHMETIC_PARSER_SIMD_INT == 2
+        // there is no vector integer division, '/' uses the scalar loop
+        template<>
+        struct SimdTraits<int>
+        {
+            using Vec = __m256i;
+            INLINE static constexpr std::size_t const width = 8;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return Op != '/';
+            }
+
+            static Vec load(const int* ptr) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); }
+            static void store(int* ptr, const Vec val) noexcept { _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), val); }
+            static Vec broadcast(const int val) noexcept { return _mm256_set1_epi32(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm256_add_epi32(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm256_sub_epi32(val1, val2);
+                }
+                else {
+                    return _mm256_mullo_epi32(val1, val2);
+                }
+            }
+        };
+#elif ARITHMETIC_PARSER_SIMD_INT == 1
+        template<>
+        struct SimdTraits<int>
+        {
+            using Vec = __m128i;
+            INLINE static constexpr std::size_t const width = 4;
+
+            template<char Op>
+            static constexpr bool supports() noexcept
+            {
+                return Op != '/';
+            }
+
+            static Vec load(const int* ptr) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+            static void store(int* ptr, const Vec val) noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), val); }
+            static Vec broadcast(const int val) noexcept { return _mm_set1_epi32(val); }
+
+            template<char Op>
+            static Vec apply(const Vec val1, const Vec val2) noexcept
+            {
+                if constexpr (Op == '+') {
+                    return _mm_add_epi32(val1, val2);
+                }
+                else if constexpr (Op == '-') {
+                    return _mm_sub_epi32(val1, val2);
+                }
+                else {
+                    return _mm_mullo_epi32(val1, val2);
+                }
+            }
+        };
+#endif
+
+        /*
+        *	out[i] = lhs[i] Op rhs[i] for count rows.
+        *	a null column pointer means the operand is the given scalar for every row.
+        *	out may be the same block as one of the operands.
+        */
+        template<char Op, typename T>
+        void applyBlock(const T* lhs, const T lhsScalar, const T* rhs, const T rhsScalar, T* out, const std::size_t count) noexcept
+        {
+            using Traits = SimdTraits<T>;
+            std::size_t i = 0;
+
+            if constexpr (Traits::width > 1 && Traits::template supports<Op>()) {
+                const auto lhsVec = Traits::broadcast(lhsScalar);
+                const auto rhsVec = Traits::broadcast(rhsScalar);
+                for (; i + Traits::width <= count; i += Traits::width) {
+                    const auto val1 = lhs != nullptr ? Traits::load(lhs + i) : lhsVec;
+                    const auto val2 = rhs != nullptr ? Traits::load(rhs + i) : rhsVec;
+                    Traits::store(out + i, Traits::template apply<Op>(val1, val2));
+                }
+            }
+
+            if (lhs != nullptr && rhs != nullptr) {
+                for (; i < count; i++) {
+                    out[i] = applyScalar<Op>(lhs[i], rhs[i]);
+                }
+            }
+            else if (lhs != nullptr) {
+                for (; i < count; i++) {
+                    out[i] = applyScalar<Op>(lhs[i], rhsScalar);
+                }
+            }
+            else {
+                for (; i < count; i++) {
+                    out[i] = applyScalar<Op>(lhsScalar, rhs[i]);
+                }
+            }
+        }
+
+        // pick the kernel once per block instead of once per row
+        template<typename T>
+        void applyBlock(const char op, const T* lhs, const T lhsScalar, const T* rhs, const T rhsScalar, T* out, const std::size_t count) noexcept
+        {
+            switch (op) {
+            case '+':
+                applyBlock<'+'>(lhs, lhsScalar, rhs, rhsScalar, out, count);
+                break;
+            case '-':
+                applyBlock<'-'>(lhs, lhsScalar, rhs, rhsScalar, out, count);
+                break;
+            case '*':
+                applyBlock<'*'>(lhs, lhsScalar, rhs, rhsScalar, out, count);
+                break;
+            case '/':
+                applyBlock<'/'>(lhs, lhsScalar, rhs, rhsScalar, out, count);
+                break;
+            }
+        }
+
+        // check a divisor column before dividing, callOperator semantics reject any zero
+        template<typename T>
+        bool containsZero(const T* column, const std::size_t count) noexcept
+        {
+            auto zero = false;
+            for (std::size_t i = 0; i < count; i++) {
+                zero |= column[i] == 0;
+            }
+            return zero;
+        }
+    }
+}
+
+#endif
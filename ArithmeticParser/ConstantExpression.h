@@ -0,0 +1,651 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Parsing and evaluation in constant expressions.
+//  Expressions known when building are evaluated by the compiler, a malformed
+//  expression is a compile error instead of an exception at run time.
+//  The _expr literal turns a formula with variables into a type which the compiler inlines.
+
+#ifndef ARITHMETIC_PARSER_CONSTANT_EXPRESSION
+#define ARITHMETIC_PARSER_CONSTANT_EXPRESSION
+
+#include <array>
+
+#include "ArithmeticParser.h"
+
+// the _expr literal needs string literals as template arguments: C++20, or the GNU extension before
+#if (defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L) || defined(__GNUC__)
+#define ARITHMETIC_PARSER_EXPRESSION_LITERAL    1
+#else
+#define ARITHMETIC_PARSER_EXPRESSION_LITERAL    0
+#endif
+
+namespace Parser
+{
+    namespace detail
+    {
+        // program of a constant expression: the nodes of its tree in postfix order, the root last
+        template<typename T, std::size_t Capacity>
+        struct ConstantProgram
+        {
+            struct Node
+            {
+                OpCode opcode{};
+                std::size_t lhs{};      // operand nodes of an operator
+                std::size_t rhs{};
+                std::size_t slot{};     // variable slot of a Load
+                T value{};              // literal of a Push
+                std::size_t offset{};   // position of the token in the expression
+            };
+
+            Node nodes[Capacity]{};
+            std::size_t size{};
+            std::string_view variables[Capacity]{};     // names by slot, in order of first appearance
+            std::size_t variableCount{};
+            ErrorCode error{};
+            std::size_t offset{};
+        };
+
+        /*
+        *	The shunting-yard loop of ArithmeticParser::parse with fixed-size stacks, which
+        *	constant evaluation allows in C++17. Operators, priorities and literal starts come
+        *	from ArithmeticParser itself, so both give the same values, errors and offsets.
+        *	The class is never instantiated, it only derives to reach the protected rules.
+        */
+        template<typename T>
+        class ConstantParser : private ArithmeticParser<T>
+        {
+            using Base = ArithmeticParser<T>;
+
+        public:
+            // Capacity bounds the stacks, the length of the expression is always enough
+            template<std::size_t Capacity>
+            static constexpr Result<T> evaluate(std::string_view strExpr) noexcept;
+
+            // the tree of the expression, variables get slots in order of their first appearance
+            template<std::size_t Capacity>
+            static constexpr ConstantProgram<T, Capacity> compile(std::string_view strExpr) noexcept;
+
+        private:
+            struct Token
+            {
+                char op{};
+                std::size_t offset{};
+            };
+
+            template<std::size_t Capacity>
+            class ValueSink;
+            template<std::size_t Capacity>
+            class CodeSink;
+
+            template<std::size_t Capacity, typename Sink>
+            static constexpr ErrorCode parse(std::string_view strExpr, Sink& sink, std::size_t& offset) noexcept;
+
+            static constexpr ErrorCode parseLiteral(std::string_view strExpr, std::size_t& pos, T& value) noexcept;
+        };
+
+        template<typename T>
+        template<std::size_t Capacity>
+        class ConstantParser<T>::ValueSink
+        {
+        public:
+            constexpr void pushValue(const T& val, std::size_t) noexcept
+            {
+                values[count++] = val;
+            }
+
+            // there are no variable values in a constant expression
+            constexpr ErrorCode pushVariable(std::string_view, std::size_t) noexcept
+            {
+                return ErrorCode::UnknownVariable;
+            }
+
+            constexpr ErrorCode applyOperator(const char op, std::size_t) noexcept
+            {
+                const auto val2 = values[--count];
+                return Base::applyOperator(values[count - 1], val2, op);
+            }
+
+            T values[Capacity]{};
+            std::size_t count{};
+        };
+
+        template<typename T>
+        template<std::size_t Capacity>
+        class ConstantParser<T>::CodeSink
+        {
+            using Node = typename ConstantProgram<T, Capacity>::Node;
+
+        public:
+            constexpr void pushValue(const T& val, const std::size_t offset) noexcept
+            {
+                push(Node{ OpCode::Push, 0, 0, 0, val, offset });
+            }
+
+            constexpr ErrorCode pushVariable(const std::string_view name, const std::size_t offset) noexcept
+            {
+                auto slot = program.variableCount;
+                for (std::size_t i = 0; i < program.variableCount; i++) {
+                    if (program.variables[i] == name) {
+                        slot = i;
+                    }
+                }
+                if (slot == program.variableCount) {
+                    program.variables[program.variableCount++] = name;
+                }
+                push(Node{ OpCode::Load, 0, 0, slot, T{}, offset });
+                return ErrorCode::None;
+            }
+
+            // literal operands are not folded here, the compiler folds them when it inlines the tree
+            constexpr ErrorCode applyOperator(const char op, const std::size_t offset) noexcept
+            {
+                const auto rhs = operands[--count];
+                const auto lhs = operands[--count];
+                push(Node{ static_cast<OpCode>(op), lhs, rhs, 0, T{}, offset });
+                return ErrorCode::None;
+            }
+
+            ConstantProgram<T, Capacity> program{};
+
+        private:
+            constexpr void push(const Node& node) noexcept
+            {
+                operands[count++] = program.size;
+                program.nodes[program.size++] = node;
+            }
+
+            std::size_t operands[Capacity]{};  // nodes of the values waiting for an operator
+            std::size_t count{};
+        };
+
+        template<typename T>
+        template<std::size_t Capacity>
+        constexpr Result<T> ConstantParser<T>::evaluate(const std::string_view strExpr) noexcept
+        {
+            ValueSink<Capacity> sink{};
+            std::size_t offset = 0;
+            const auto code = parse<Capacity>(strExpr, sink, offset);
+            if (code != ErrorCode::None) {
+                return Result<T>{ code, offset };
+            }
+            return Result<T>{ sink.values[0] };
+        }
+
+        template<typename T>
+        template<std::size_t Capacity>
+        constexpr ConstantProgram<T, Capacity> ConstantParser<T>::compile(const std::string_view strExpr) noexcept
+        {
+            CodeSink<Capacity> sink{};
+            std::size_t offset = 0;
+            const auto code = parse<Capacity>(strExpr, sink, offset);
+            sink.program.error = code;
+            sink.program.offset = code != ErrorCode::None ? offset : 0;
+            return sink.program;
+        }
+
+        template<typename T>
+        template<std::size_t Capacity, typename Sink>
+        constexpr ErrorCode ConstantParser<T>::parse(const std::string_view strExpr, Sink& sink, std::size_t& offset) noexcept
+        {
+            Token ops[Capacity]{};
+            std::size_t opCount = 0;
+            std::size_t depth = 0;      // number of values held by the sink
+
+            // pop an operator and apply it to the sink, as ArithmeticParser::reduce
+            const auto reduce = [&]() {
+                const auto token = ops[--opCount];
+                offset = token.offset;
+                if (depth < 2) {
+                    switch (token.op) {
+                    case '+':
+                        return depth == 0 ? ErrorCode::MissingOperand : ErrorCode::None;
+                    case '-':
+                        return ErrorCode::UnaryMinus;
+                    default:
+                        return ErrorCode::MissingOperand;
+                    }
+                }
+                --depth;
+                return sink.applyOperator(token.op, token.offset);
+            };
+
+            std::size_t pos = 0;
+            while (pos != strExpr.size() && isSpace(strExpr[pos])) {
+                ++pos;
+            }
+            if (pos == strExpr.size()) {
+                offset = 0;
+                return ErrorCode::EmptyExpression;
+            }
+
+            while (pos != strExpr.size()) {
+                const auto ch = strExpr[pos];
+                if (isSpace(ch)) {
+                    ++pos;
+                    continue;
+                }
+
+                const auto position = pos;
+                if (Base::isLiteralStart(strExpr.data() + pos, strExpr.data() + strExpr.size())) {
+                    T val{};
+                    const auto code = parseLiteral(strExpr, pos, val);
+                    if (code != ErrorCode::None) {
+                        offset = position;
+                        return code;
+                    }
+                    sink.pushValue(val, position);
+                    ++depth;
+                    continue;
+                }
+
+                if (isIdentifierStart(ch)) {
+                    while (++pos != strExpr.size() && isIdentifierChar(strExpr[pos])) {
+                    }
+                    const auto code = sink.pushVariable(strExpr.substr(position, pos - position), position);
+                    if (code != ErrorCode::None) {
+                        offset = position;
+                        return code;
+                    }
+                    ++depth;
+                    continue;
+                }
+
+                if (ch == '(') {
+                    ops[opCount++] = Token{ ch, position };
+                }
+                else if (ch == ')') {
+                    while (opCount != 0 && ops[opCount - 1].op != '(') {
+                        const auto code = reduce();
+                        if (code != ErrorCode::None) {
+                            return code;
+                        }
+                    }
+                    if (opCount == 0) {
+                        offset = position;
+                        return ErrorCode::UnbalancedParentheses;
+                    }
+                    --opCount;
+                }
+                else {
+                    // the binary operators are exactly the characters with a priority
+                    if (Base::operatorPriority(ch) == 0) {
+                        offset = position;
+                        return ErrorCode::InvalidToken;
+                    }
+                    while (opCount != 0 && Base::operatorPriority(ops[opCount - 1].op) >= Base::operatorPriority(ch)) {
+                        const auto code = reduce();
+                        if (code != ErrorCode::None) {
+                            return code;
+                        }
+                    }
+                    ops[opCount++] = Token{ ch, position };
+                }
+                ++pos;
+            }
+
+            while (opCount != 0) {
+                if (ops[opCount - 1].op == '(') {
+                    offset = ops[opCount - 1].offset;
+                    return ErrorCode::UnbalancedParentheses;
+                }
+                const auto code = reduce();
+                if (code != ErrorCode::None) {
+                    return code;
+                }
+            }
+
+            if (depth != 1) {
+                offset = strExpr.size();
+                return depth == 0 ? ErrorCode::MissingOperand : ErrorCode::MissingOperator;
+            }
+            return ErrorCode::None;
+        }
+
+        template<typename T>
+        constexpr ErrorCode ConstantParser<T>::parseLiteral(const std::string_view strExpr, std::size_t& pos, T& value) noexcept
+        {
+            // the digits are read as by scanDigits, without the SWAR loads which are not constexpr
+            std::uint64_t mantissa = 0;
+            auto significant = 0;
+            auto dropped = 0;
+            const auto scan = [&]() {
+                for (; pos != strExpr.size() && isDigit(strExpr[pos]); ++pos) {
+                    if (significant < MAX_U64_DIGITS) {
+                        mantissa = mantissa * 10 + static_cast<std::uint64_t>(strExpr[pos] - '0');
+                        ++significant;
+                    }
+                    else {
+                        ++dropped;
+                    }
+                }
+            };
+
+            while (pos != strExpr.size() && strExpr[pos] == '0') {
+                ++pos;
+            }
+            scan();
+
+            if constexpr (!std::is_floating_point<T>::value) {
+                if (dropped != 0 || (std::numeric_limits<T>::is_specialized &&
+                    mantissa > static_cast<std::uint64_t>((std::numeric_limits<T>::max)()))) {
+                    return ErrorCode::LiteralTooLarge;
+                }
+                value = static_cast<T>(mantissa);
+                return ErrorCode::None;
+            }
+            else {
+                using Limits = FastPathLimits<T>;
+
+                auto exponent = 0;
+                if (pos != strExpr.size() && strExpr[pos] == '.') {
+                    ++pos;
+                    if (mantissa == 0) {
+                        for (; pos != strExpr.size() && strExpr[pos] == '0'; ++pos) {
+                            --exponent;
+                        }
+                    }
+                    const auto integerDigits = significant;
+                    scan();
+                    exponent -= significant - integerDigits;
+                }
+
+                if (pos != strExpr.size() && (strExpr[pos] == 'e' || strExpr[pos] == 'E')) {
+                    auto next = pos + 1;
+                    const auto negative = next != strExpr.size() && strExpr[next] == '-';
+                    if (next != strExpr.size() && (strExpr[next] == '+' || strExpr[next] == '-')) {
+                        ++next;
+                    }
+                    if (next != strExpr.size() && isDigit(strExpr[next])) {
+                        auto digits = 0;
+                        for (; next != strExpr.size() && isDigit(strExpr[next]); ++next) {
+                            if (digits < 100000) {
+                                digits = digits * 10 + (strExpr[next] - '0');
+                            }
+                        }
+                        exponent += negative ? -digits : digits;
+                        pos = next;
+                    }
+                }
+
+                /*
+                *	Only the exact conversions of parseFloating are available, from_chars cannot
+                *	run in constant evaluation. These cover literals with up to 15 significant
+                *	digits and moderate exponents, others are reported as out of range.
+                */
+                if (!Limits::enabled || dropped != 0) {
+                    return ErrorCode::LiteralOutOfRange;
+                }
+                if (mantissa == 0) {
+                    value = T{};
+                    return ErrorCode::None;
+                }
+                // a large exponent can move into the mantissa while that stays exact, e.g. 1e30 = 1e8 * 1e22
+                while (exponent > Limits::max_exponent && mantissa <= Limits::max_mantissa / 10) {
+                    mantissa *= 10;
+                    --exponent;
+                }
+                if (mantissa > Limits::max_mantissa || exponent < -Limits::max_exponent || exponent > Limits::max_exponent) {
+                    return ErrorCode::LiteralOutOfRange;
+                }
+                const auto power = static_cast<T>(POWERS_OF_TEN[exponent < 0 ? -exponent : exponent]);
+                value = static_cast<T>(mantissa);
+                value = exponent < 0 ? value / power : value * power;
+                return ErrorCode::None;
+            }
+        }
+
+        // reached only for malformed expressions, the call makes them fail to compile in constant evaluation
+        [[noreturn]] inline void malformedConstantExpression(const ErrorCode code, const std::size_t offset)
+        {
+            throw ParserException{ code, offset };
+        }
+
+        template<std::size_t N>
+        constexpr std::string_view literalText(const char (&strExpr)[N]) noexcept
+        {
+            return std::string_view{ strExpr, strExpr[N - 1] == '\0' ? N - 1 : N };
+        }
+    }
+
+    /*
+    *	Parses and evaluates a string literal with the rules of ArithmeticParser<T>, errors
+    *	are reported in the result. In a constant expression the work is done by the compiler:
+    *	    constexpr auto result = Parser::tryEvaluateConstant<int>("(4 + 5 * (7 - 3)) - 2");
+    *	Floating point literals must convert exactly (up to 15 significant digits), others
+    *	give ErrorCode::LiteralOutOfRange.
+    */
+    template<typename T, std::size_t N>
+    constexpr Result<T> tryEvaluateConstant(const char (&strExpr)[N]) noexcept
+    {
+        return detail::ConstantParser<T>::template evaluate<N>(detail::literalText(strExpr));
+    }
+
+    /*
+    *	Same as tryEvaluateConstant, but a malformed expression does not compile when the
+    *	result initializes a constexpr variable:
+    *	    constexpr int value = Parser::evaluateConstant<int>("4 / 0");   // error
+    *	Evaluated at run time, it throws ParserException like parseAndEvaluate.
+    */
+    template<typename T, std::size_t N>
+    constexpr T evaluateConstant(const char (&strExpr)[N])
+    {
+        const auto result = tryEvaluateConstant<T>(strExpr);
+        if (!result) {
+            detail::malformedConstantExpression(result.error(), result.offset());
+        }
+        return result.value();
+    }
+
+    namespace detail
+    {
+        // program of the expression Text for the value type T, literals are parsed as in ArithmeticParser<T>
+        template<typename Text, typename T>
+        struct StaticProgram
+        {
+            INLINE static constexpr auto const value = ConstantParser<T>::template compile<Text::text.size() + 1>(Text::text);
+        };
+
+        // node Index of a program as a function of the variables, the opcode picks the specialization
+        template<typename Program, std::size_t Index, OpCode Op = Program::value.nodes[Index].opcode>
+        struct StaticNode
+        {
+            // binary operators, the operands are computed left to right as by the interpreter
+            template<typename T, std::size_t N>
+            static constexpr T evaluate(const std::array<T, N>& variables)
+            {
+                const T lhs = StaticNode<Program, Program::value.nodes[Index].lhs>::evaluate(variables);
+                const T rhs = StaticNode<Program, Program::value.nodes[Index].rhs>::evaluate(variables);
+                if constexpr (Op == OpCode::Add) {
+                    return lhs + rhs;
+                }
+                else if constexpr (Op == OpCode::Sub) {
+                    return lhs - rhs;
+                }
+                else if constexpr (Op == OpCode::Mul) {
+                    return lhs * rhs;
+                }
+                else {
+                    static_assert(Op == OpCode::Div, "unexpected opcode");
+                    if (rhs == 0) {
+                        throw ParserException{ ErrorCode::DivisionByZero, Program::value.nodes[Index].offset };
+                    }
+                    return lhs / rhs;
+                }
+            }
+        };
+
+        template<typename Program, std::size_t Index>
+        struct StaticNode<Program, Index, OpCode::Push>
+        {
+            template<typename T, std::size_t N>
+            static constexpr T evaluate(const std::array<T, N>&) noexcept
+            {
+                return Program::value.nodes[Index].value;
+            }
+        };
+
+        template<typename Program, std::size_t Index>
+        struct StaticNode<Program, Index, OpCode::Load>
+        {
+            template<typename T, std::size_t N>
+            static constexpr T evaluate(const std::array<T, N>& variables) noexcept
+            {
+                return variables[Program::value.nodes[Index].slot];
+            }
+        };
+
+        // value type of a call, int when there are no arguments
+        template<typename... Args>
+        struct ArgumentType
+        {
+            using type = std::common_type_t<Args...>;
+        };
+
+        template<>
+        struct ArgumentType<>
+        {
+            using type = int;
+        };
+    }
+
+    /*
+    *	Expression compiled into a type of its own by the _expr literal. A call computes the tree
+    *	as straight-line code, without an interpreter loop, a value stack or a switch on operators,
+    *	so the compiler inlines it like the same formula written in C++.
+    *	Variables are the arguments in order of their first appearance, as the slots of compile().
+    *	Literals are parsed for the type of the arguments, "x / 2.5"_expr wants floating point values.
+    *	A malformed expression or a wrong number of arguments is a compile error.
+    *	Division by zero throws ParserException, or fails to compile in a constant expression.
+    */
+    template<typename Text>
+    class StaticExpression
+    {
+    public:
+        NODISCARD static constexpr std::string_view text() noexcept
+        {
+            return Text::text;
+        }
+
+        template<typename T = int>
+        NODISCARD static constexpr std::size_t variableCount() noexcept
+        {
+            return detail::StaticProgram<Text, T>::value.variableCount;
+        }
+
+        // the value type is the common type of the arguments
+        template<typename... Args>
+        constexpr auto operator()(const Args&... args) const
+        {
+            return evaluate<typename detail::ArgumentType<Args...>::type>(args...);
+        }
+
+        // values of another type are converted to T first
+        template<typename T, typename... Args>
+        static constexpr T evaluate(const Args&... args)
+        {
+            using Program = detail::StaticProgram<Text, T>;
+            constexpr auto const valid = Program::value.error == ErrorCode::None;
+            static_assert(valid, "malformed expression, tryEvaluateConstant reports the error");
+            static_assert(!valid || sizeof...(Args) == Program::value.variableCount, "one argument per variable is expected");
+            if constexpr (valid && sizeof...(Args) == Program::value.variableCount) {
+                const std::array<T, sizeof...(Args)> variables{ { static_cast<T>(args)... } };
+                return detail::StaticNode<Program, Program::value.size - 1>::evaluate(variables);
+            }
+            else {
+                return T{};
+            }
+        }
+    };
+
+#if ARITHMETIC_PARSER_EXPRESSION_LITERAL
+    namespace detail
+    {
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+        // string literal as a template argument (C++20)
+        template<std::size_t N>
+        struct FixedString
+        {
+            constexpr FixedString(const char (&str)[N]) noexcept
+            {
+                for (std::size_t i = 0; i < N; i++) {
+                    chars[i] = str[i];
+                }
+            }
+
+            char chars[N]{};
+        };
+
+        template<FixedString Str>
+        struct FixedText
+        {
+            INLINE static constexpr std::string_view const text{ Str.chars, sizeof(Str.chars) - 1 };
+        };
+#else
+        template<char... Chars>
+        struct CharText
+        {
+            INLINE static constexpr char const chars[] = { Chars..., '\0' };
+            INLINE static constexpr std::string_view const text{ chars, sizeof...(Chars) };
+        };
+#endif
+    }
+
+    namespace literals
+    {
+        /*
+        *	using namespace Parser::literals;
+        *	constexpr auto formula = "a * b + c"_expr;
+        *	double value = formula(2.0, 3.0, 4.0);     // 10
+        */
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+        template<detail::FixedString Str>
+        constexpr auto operator""_expr() noexcept
+        {
+            return StaticExpression<detail::FixedText<Str>>{};
+        }
+#else
+        // string literal operator templates are a GNU extension before C++20
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-string-literal-operator-template"
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+        template<typename Char, Char... Chars>
+        constexpr auto operator""_expr() noexcept
+        {
+            static_assert(std::is_same<Char, char>::value, "expressions are narrow strings");
+            return StaticExpression<detail::CharText<Chars...>>{};
+        }
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#else
+#pragma GCC diagnostic pop
+#endif
+#endif
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,310 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Cache of compiled expressions keyed by their text.
+//  Expressions which are seen over and over are lexed and parsed only once,
+//  later lookups share the compiled program.
+
+#ifndef ARITHMETIC_PARSER_EXPRESSION_CACHE
+#define ARITHMETIC_PARSER_EXPRESSION_CACHE
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+#include "ArithmeticParser.h"
+
+namespace Parser
+{
+    namespace detail
+    {
+        // characters which form one token when they are next to each other
+        constexpr bool isWordChar(const char ch) noexcept
+        {
+            return isIdentifierChar(ch) || ch == '.';
+        }
+
+        /*
+        *	Writes the expression without the whitespace which does not separate tokens,
+        *	so "1+2" and " 1 + 2 " give the same text but "1 2" and "12" do not.
+        *	A space is kept where removing it would join two tokens, including the
+        *	exponent of a literal: "1e +5" and "1e+ 5" are not "1e+5".
+        */
+        inline void normalizeExpression(const std::string_view strExpr, std::string& normalized)
+        {
+            normalized.clear();
+            std::size_t i = 0;
+            while (i < strExpr.size()) {
+                if (!isSpace(strExpr[i])) {
+                    normalized += strExpr[i++];
+                    continue;
+                }
+                while (i < strExpr.size() && isSpace(strExpr[i])) {
+                    ++i;
+                }
+                if (normalized.empty() || i == strExpr.size()) {
+                    continue;
+                }
+
+                const auto prev = normalized.back();
+                const auto next = strExpr[i];
+                const auto joinsWord = isWordChar(prev) && (isWordChar(next) ||
+                    ((prev == 'e' || prev == 'E') && (next == '+' || next == '-')));
+                const auto joinsExponent = (prev == '+' || prev == '-') && normalized.size() > 1 &&
+                    (normalized[normalized.size() - 2] == 'e' || normalized[normalized.size() - 2] == 'E') && isWordChar(next);
+                if (joinsWord || joinsExponent) {
+                    normalized += ' ';
+                }
+            }
+        }
+    }
+
+    // counters of an ExpressionCache, summed over its shards
+    struct CacheStatistics
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t entries;
+        std::size_t memory;     // estimated bytes held by the entries
+    };
+
+    /*
+    *	Thread-safe LRU cache which maps expression text to shared compiled programs.
+    *	The text is normalized before the lookup, so expressions which only differ in
+    *	insignificant whitespace share one entry. Entries are spread over shards by hash,
+    *	each with its own lock and LRU list, so concurrent lookups rarely wait on each other.
+    *	Each shard evicts its least recently used entries when it holds more than its part
+    *	of the memory limit. Expressions which do not compile are not cached.
+    *	Evaluation errors (division by zero) report offsets in the spelling that was compiled first.
+    */
+    template<typename T>
+    class ExpressionCache
+    {
+    public:
+        using Program = std::shared_ptr<const CompiledExpression<T>>;
+
+        INLINE static constexpr std::size_t const DEFAULT_MEMORY_LIMIT = 16 * 1024 * 1024;
+        INLINE static constexpr std::size_t const DEFAULT_SHARD_COUNT = 16;
+
+        explicit ExpressionCache(std::size_t memoryLimit = DEFAULT_MEMORY_LIMIT, std::size_t shardCount = DEFAULT_SHARD_COUNT);
+        // non-copyable class
+        ExpressionCache(const ExpressionCache&) = delete;
+        ExpressionCache& operator=(const ExpressionCache&) = delete;
+        ~ExpressionCache() = default;
+
+        // compiled program of the expression, compiled and inserted on a miss.
+        // get throws ParserException if the expression is malformed, tryGet reports it instead.
+        NODISCARD Program get(std::string_view strExpr);
+        NODISCARD Result<Program> tryGet(std::string_view strExpr) noexcept;
+
+        // lookup and evaluation in one call, for expressions without variables
+        NODISCARD T evaluate(std::string_view strExpr);
+        NODISCARD Result<T> tryEvaluate(std::string_view strExpr) noexcept;
+
+        NODISCARD CacheStatistics statistics() const;
+
+        // remove all entries, the counters are kept
+        void clear();
+
+    private:
+        struct Entry
+        {
+            std::string key;    // normalized expression
+            Program program;
+            std::size_t cost;
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<Entry> entries;   // most recently used first
+            std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index;    // keys point into entries
+            std::size_t memory{};
+            std::atomic<std::uint64_t> hits{};
+            std::atomic<std::uint64_t> misses{};
+            std::atomic<std::uint64_t> evictions{};
+        };
+
+        // lookup core shared by get and tryGet
+        ErrorCode lookup(std::string_view strExpr, Program& program, std::size_t& offset);
+        // estimated bytes held by an entry
+        static std::size_t cost(const std::string& key, const CompiledExpression<T>& program) noexcept;
+
+        std::unique_ptr<Shard[]> m_shards;
+        std::size_t m_shardCount;
+        std::size_t m_shardLimit;   // memory limit of each shard
+    };
+
+    template<typename T>
+    ExpressionCache<T>::ExpressionCache(const std::size_t memoryLimit, const std::size_t shardCount) :
+        m_shards{ new Shard[shardCount == 0 ? 1 : shardCount] },
+        m_shardCount{ shardCount == 0 ? 1 : shardCount },
+        m_shardLimit{ memoryLimit / (shardCount == 0 ? 1 : shardCount) }
+    {
+    }
+
+    template<typename T>
+    typename ExpressionCache<T>::Program ExpressionCache<T>::get(const std::string_view strExpr)
+    {
+        Program program;
+        std::size_t offset = 0;
+        const auto code = lookup(strExpr, program, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+        return program;
+    }
+
+    template<typename T>
+    Result<typename ExpressionCache<T>::Program> ExpressionCache<T>::tryGet(const std::string_view strExpr) noexcept
+    {
+        try {
+            Program program;
+            std::size_t offset = 0;
+            const auto code = lookup(strExpr, program, offset);
+            if (code != ErrorCode::None) {
+                return Result<Program>{ code, offset };
+            }
+            return Result<Program>{ std::move(program) };
+        }
+        catch (const std::bad_alloc&) {
+            return Result<Program>{ ErrorCode::OutOfMemory, 0 };
+        }
+        catch (const std::system_error&) {
+            // a mutex could not be locked
+            return Result<Program>{ ErrorCode::OutOfMemory, 0 };
+        }
+    }
+
+    template<typename T>
+    T ExpressionCache<T>::evaluate(const std::string_view strExpr)
+    {
+        return get(strExpr)->evaluate();
+    }
+
+    template<typename T>
+    Result<T> ExpressionCache<T>::tryEvaluate(const std::string_view strExpr) noexcept
+    {
+        const auto program = tryGet(strExpr);
+        if (!program) {
+            return Result<T>{ program.error(), program.offset() };
+        }
+        return program.value()->tryEvaluate();
+    }
+
+    template<typename T>
+    ErrorCode ExpressionCache<T>::lookup(const std::string_view strExpr, Program& program, std::size_t& offset)
+    {
+        // per-thread buffers, a hit does not allocate
+        thread_local std::string key;
+        thread_local ArithmeticParser<T> parser;
+
+        detail::normalizeExpression(strExpr, key);
+        auto& shard = m_shards[std::hash<std::string_view>{}(key) % m_shardCount];
+
+        {
+            std::lock_guard<std::mutex> lock{ shard.mutex };
+            const auto iter = shard.index.find(key);
+            if (iter != shard.index.end()) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, iter->second);
+                program = iter->second->program;
+                shard.hits.fetch_add(1, std::memory_order_relaxed);
+                return ErrorCode::None;
+            }
+        }
+
+        // compile without holding the lock, other threads may look up meanwhile
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        auto compiled = parser.tryCompile(strExpr);
+        if (!compiled) {
+            offset = compiled.offset();
+            return compiled.error();
+        }
+        program = std::make_shared<const CompiledExpression<T>>(std::move(compiled).value());
+
+        std::lock_guard<std::mutex> lock{ shard.mutex };
+        const auto iter = shard.index.find(key);
+        if (iter != shard.index.end()) {
+            // another thread compiled it first, share its program
+            program = iter->second->program;
+            return ErrorCode::None;
+        }
+
+        // costed from the stored copy, the capacity of the thread_local key depends on earlier lookups
+        shard.entries.push_front(Entry{ key, program, 0 });
+        auto& entry = shard.entries.front();
+        entry.cost = cost(entry.key, *program);
+        shard.index.emplace(entry.key, shard.entries.begin());
+        shard.memory += entry.cost;
+
+        // the new entry is kept even if it is larger than the limit on its own
+        while (shard.memory > m_shardLimit && shard.entries.size() > 1) {
+            const auto& victim = shard.entries.back();
+            shard.memory -= victim.cost;
+            shard.index.erase(victim.key);
+            shard.entries.pop_back();
+            shard.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    std::size_t ExpressionCache<T>::cost(const std::string& key, const CompiledExpression<T>& program) noexcept
+    {
+        return sizeof(Entry) + sizeof(CompiledExpression<T>) + key.capacity() + program.memoryUsage() +
+            4 * sizeof(void*);	// list and index nodes
+    }
+
+    template<typename T>
+    CacheStatistics ExpressionCache<T>::statistics() const
+    {
+        CacheStatistics stats{};
+        for (std::size_t i = 0; i < m_shardCount; i++) {
+            auto& shard = m_shards[i];
+            stats.hits += shard.hits.load(std::memory_order_relaxed);
+            stats.misses += shard.misses.load(std::memory_order_relaxed);
+            stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock{ shard.mutex };
+            stats.entries += shard.entries.size();
+            stats.memory += shard.memory;
+        }
+        return stats;
+    }
+
+    template<typename T>
+    void ExpressionCache<T>::clear()
+    {
+        for (std::size_t i = 0; i < m_shardCount; i++) {
+            auto& shard = m_shards[i];
+            std::lock_guard<std::mutex> lock{ shard.mutex };
+            shard.index.clear();
+            shard.entries.clear();
+            shard.memory = 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,533 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Optional native backend for compiled expressions.
+//  JitExpression<T> translates the postfix program of a CompiledExpression<int> or
+//  CompiledExpression<double> into x86-64 machine code, with every entry of the value
+//  stack held in its own register. It has no dependencies besides the operating system's
+//  mmap/mprotect and falls back to the interpreter whenever native code cannot be used.
+
+#ifndef ARITHMETIC_PARSER_JIT_EXPRESSION
+#define ARITHMETIC_PARSER_JIT_EXPRESSION
+
+#include "ArithmeticParser.h"
+
+// native code is generated for the System V x86-64 calling convention only
+#if !defined(ARITHMETIC_PARSER_JIT)
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define ARITHMETIC_PARSER_JIT   1
+#else
+#define ARITHMETIC_PARSER_JIT   0
+#endif
+#endif
+
+#if ARITHMETIC_PARSER_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Parser
+{
+    namespace detail
+    {
+        // little x86-64 assembler, just the encodings the JIT needs
+        class X64Emitter
+        {
+        public:
+            INLINE static constexpr int const RAX = 0;
+            INLINE static constexpr int const RCX = 1;
+            INLINE static constexpr int const RDX = 2;
+            INLINE static constexpr int const RBX = 3;
+            INLINE static constexpr int const RBP = 5;
+            INLINE static constexpr int const RSI = 6;
+            INLINE static constexpr int const RDI = 7;
+
+            void byte(const std::uint8_t val)
+            {
+                m_code.push_back(val);
+            }
+
+            void imm32(const std::uint32_t val)
+            {
+                for (auto i = 0; i < 4; i++) {
+                    byte(static_cast<std::uint8_t>(val >> (i * 8)));
+                }
+            }
+
+            void imm64(const std::uint64_t val)
+            {
+                imm32(static_cast<std::uint32_t>(val));
+                imm32(static_cast<std::uint32_t>(val >> 32));
+            }
+
+            // REX prefix, only emitted when one of its bits is needed
+            void rex(const bool wide, const int reg, const int rm)
+            {
+                const auto prefix = static_cast<std::uint8_t>(0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (rm >> 3));
+                if (prefix != 0x40) {
+                    byte(prefix);
+                }
+            }
+
+            void modrmReg(const int reg, const int rm)
+            {
+                byte(static_cast<std::uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+            }
+
+            // [base + disp32], base must not be rsp or r12 which would need a SIB byte
+            void modrmMem(const int reg, const int base, const std::uint32_t disp)
+            {
+                byte(static_cast<std::uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+                imm32(disp);
+            }
+
+            // jcc/jmp with a rel32 to be patched, returns the position of the rel32
+            std::size_t jump(const std::uint8_t opcode)
+            {
+                if (opcode != 0xE9) {
+                    byte(0x0F);
+                }
+                byte(opcode);
+                const auto position = m_code.size();
+                imm32(0);
+                return position;
+            }
+
+            void patch(const std::size_t position, const std::size_t target)
+            {
+                const auto rel = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(position + 4));
+                for (auto i = 0; i < 4; i++) {
+                    m_code[position + i] = static_cast<std::uint8_t>(rel >> (i * 8));
+                }
+            }
+
+            NODISCARD std::size_t size() const noexcept
+            {
+                return m_code.size();
+            }
+
+            NODISCARD const std::uint8_t* data() const noexcept
+            {
+                return m_code.data();
+            }
+
+        private:
+            std::vector<std::uint8_t> m_code;
+        };
+    }
+
+    /*
+    *	Native version of a compiled expression, for ArithmeticParserInt and ArithmeticParserDouble.
+    *	The program is translated once in the constructor, evaluation is then a single call into
+    *	the generated code without any dispatch. Division by zero is checked in the generated code,
+    *	which returns to evaluate() to report it the same way as the interpreter.
+    *	The interpreter is used instead when native code is not available: other platforms,
+    *	programs needing more registers than the pool holds, or when the system refuses
+    *	to map executable memory. native() tells which one is used.
+    *	Like CompiledExpression, an instance can be shared by any number of threads.
+    */
+    template<typename T>
+    class JitExpression
+    {
+        static_assert(std::is_same<T, int>::value || std::is_same<T, double>::value,
+            "JitExpression supports int and double");
+
+        // generated function: status (0 or error site + 1), variables, temporaries, result
+        using Function = int (*)(const T*, T*, T*);
+
+    public:
+        explicit JitExpression(CompiledExpression<T> program);
+        ~JitExpression();
+        // non-copyable class
+        JitExpression(const JitExpression&) = delete;
+        JitExpression& operator=(const JitExpression&) = delete;
+        JitExpression(JitExpression&& other) noexcept;
+        JitExpression& operator=(JitExpression&& other) noexcept;
+
+        // same contract as the functions of CompiledExpression
+        NODISCARD T evaluate() const;
+        NODISCARD T evaluate(const T* variables) const;
+        NODISCARD Result<T> tryEvaluate() const noexcept;
+        NODISCARD Result<T> tryEvaluate(const T* variables) const noexcept;
+
+        // true if evaluation runs generated machine code, false if it falls back to the interpreter
+        NODISCARD bool native() const noexcept
+        {
+            return m_function != nullptr;
+        }
+
+        // the interpreted program, also used for its variables
+        NODISCARD const CompiledExpression<T>& program() const noexcept
+        {
+            return m_program;
+        }
+
+    private:
+        // registers of the value stack, entry i of the stack lives in REGISTERS[i]
+        // int: rax and rdx are taken by idiv, rdi/rsi hold the arguments and rbp the result pointer.
+        // double: xmm15 is kept as scratch for the division check.
+        INLINE static constexpr int const INT_REGISTERS[] = { 1, 8, 9, 10, 11, 3, 12, 13, 14, 15 };
+        INLINE static constexpr std::size_t const REGISTER_COUNT = std::is_same<T, int>::value ? 10 : 15;
+        // temporaries live in a local array of evaluate()
+        INLINE static constexpr std::size_t const MAX_TEMPS = ARITHMETIC_PARSER_STACK_DEPTH;
+
+        // translate m_program into m_function, leaves it null if this is not possible
+        void generate();
+        void release() noexcept;
+        ErrorCode run(const T* variables, T& result, std::size_t& offset) const noexcept;
+
+        CompiledExpression<T> m_program;
+        std::vector<std::uint32_t> m_errorOffsets;	// expression offset of each error site
+        Function m_function{};
+        void* m_memory{};	// mapped pages holding m_function
+        std::size_t m_mappedSize{};
+    };
+
+    template<typename T>
+    JitExpression<T>::JitExpression(CompiledExpression<T> program) :
+        m_program{ std::move(program) }
+    {
+        generate();
+    }
+
+    template<typename T>
+    JitExpression<T>::~JitExpression()
+    {
+        release();
+    }
+
+    template<typename T>
+    JitExpression<T>::JitExpression(JitExpression&& other) noexcept :
+        m_program{ std::move(other.m_program) },
+        m_errorOffsets{ std::move(other.m_errorOffsets) },
+        m_function{ other.m_function },
+        m_memory{ other.m_memory },
+        m_mappedSize{ other.m_mappedSize }
+    {
+        other.m_function = nullptr;
+        other.m_memory = nullptr;
+        other.m_mappedSize = 0;
+    }
+
+    template<typename T>
+    JitExpression<T>& JitExpression<T>::operator=(JitExpression&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            m_program = std::move(other.m_program);
+            m_errorOffsets = std::move(other.m_errorOffsets);
+            m_function = other.m_function;
+            m_memory = other.m_memory;
+            m_mappedSize = other.m_mappedSize;
+            other.m_function = nullptr;
+            other.m_memory = nullptr;
+            other.m_mappedSize = 0;
+        }
+        return *this;
+    }
+
+    template<typename T>
+    void JitExpression<T>::release() noexcept
+    {
+#if ARITHMETIC_PARSER_JIT
+        if (m_memory != nullptr) {
+            ::munmap(m_memory, m_mappedSize);
+        }
+#endif
+        m_memory = nullptr;
+        m_function = nullptr;
+        m_mappedSize = 0;
+    }
+
+    template<typename T>
+    void JitExpression<T>::generate()
+    {
+#if ARITHMETIC_PARSER_JIT
+        using Emitter = detail::X64Emitter;
+        constexpr auto const isInt = std::is_same<T, int>::value;
+
+        if (m_program.empty() || m_program.m_maxDepth > REGISTER_COUNT || m_program.m_tempCount > MAX_TEMPS) {
+            return;
+        }
+
+        const auto reg = [](const std::size_t depth) noexcept {
+            return isInt ? INT_REGISTERS[depth] : static_cast<int>(depth);
+        };
+
+        Emitter emitter;
+        // scalar SSE2 instruction: prefix [rex] 0f opcode modrm
+        const auto sse = [&emitter](const std::uint8_t prefix, const std::uint8_t opcode, const int reg, const int rm) {
+            emitter.byte(prefix);
+            emitter.rex(false, reg, rm);
+            emitter.byte(0x0F);
+            emitter.byte(opcode);
+        };
+
+        // rel32 positions of the jumps to each error site
+        std::vector<std::size_t> errorJumps;
+
+        if constexpr (isInt) {
+            // save the callee-saved registers of the pool, keep the result pointer in rbp
+            emitter.byte(0x53);         // push rbx
+            emitter.byte(0x55);         // push rbp
+            for (auto r = 12; r <= 15; r++) {
+                emitter.byte(0x41);     // push r12..r15
+                emitter.byte(static_cast<std::uint8_t>(0x50 + (r & 7)));
+            }
+            emitter.rex(true, Emitter::RDX, Emitter::RBP);
+            emitter.byte(0x89);         // mov rbp, rdx
+            emitter.modrmReg(Emitter::RDX, Emitter::RBP);
+        }
+
+        std::size_t depth = 0;
+        for (const auto& instruction : m_program.m_code) {
+            const auto disp = static_cast<std::uint32_t>(instruction.operand * sizeof(T));
+            switch (instruction.opcode) {
+            case OpCode::Push:
+            {
+                const auto dst = reg(depth++);
+                if constexpr (isInt) {
+                    emitter.rex(false, 0, dst);
+                    emitter.byte(static_cast<std::uint8_t>(0xB8 + (dst & 7)));     // mov r32, imm32
+                    emitter.imm32(static_cast<std::uint32_t>(instruction.value));
+                }
+                else {
+                    std::uint64_t bits = 0;
+                    std::memcpy(&bits, &instruction.value, sizeof(bits));
+                    emitter.byte(0x48);
+                    emitter.byte(0xB8);     // mov rax, imm64
+                    emitter.imm64(bits);
+                    emitter.byte(0x66);
+                    emitter.rex(true, dst, Emitter::RAX);
+                    emitter.byte(0x0F);
+                    emitter.byte(0x6E);     // movq xmm, rax
+                    emitter.modrmReg(dst, Emitter::RAX);
+                }
+                break;
+            }
+            case OpCode::Load:
+            case OpCode::LoadTemp:
+            {
+                const auto dst = reg(depth++);
+                const auto base = instruction.opcode == OpCode::Load ? Emitter::RDI : Emitter::RSI;
+                if constexpr (isInt) {
+                    emitter.rex(false, dst, base);
+                    emitter.byte(0x8B);     // mov r32, [base + disp]
+                }
+                else {
+                    sse(0xF2, 0x10, dst, base);     // movsd xmm, [base + disp]
+                }
+                emitter.modrmMem(dst, base, disp);
+                break;
+            }
+            case OpCode::StoreTemp:
+            {
+                const auto src = reg(depth - 1);
+                if constexpr (isInt) {
+                    emitter.rex(false, src, Emitter::RSI);
+                    emitter.byte(0x89);     // mov [rsi + disp], r32
+                }
+                else {
+                    sse(0xF2, 0x11, src, Emitter::RSI);     // movsd [rsi + disp], xmm
+                }
+                emitter.modrmMem(src, Emitter::RSI, disp);
+                break;
+            }
+            default:
+            {
+                const auto src = reg(--depth);
+                const auto dst = reg(depth - 1);
+                const auto op = static_cast<char>(instruction.opcode);
+
+                if (op == '/') {
+                    // divisor == 0 jumps to the error site of this instruction
+                    if constexpr (isInt) {
+                        emitter.rex(false, src, src);
+                        emitter.byte(0x85);     // test src, src
+                        emitter.modrmReg(src, src);
+                    }
+                    else {
+                        constexpr auto const scratch = 15;
+                        sse(0x66, 0x57, scratch, scratch);  // xorpd xmm15, xmm15
+                        emitter.modrmReg(scratch, scratch);
+                        sse(0x66, 0x2E, src, scratch);      // ucomisd src, xmm15
+                        emitter.modrmReg(src, scratch);
+                        emitter.byte(0x7A);     // jp over the je, NaN is not zero
+                        emitter.byte(0x06);
+                    }
+                    errorJumps.push_back(emitter.jump(0x84));   // je error
+                    m_errorOffsets.push_back(instruction.operand);
+                }
+
+                if constexpr (isInt) {
+                    switch (op) {
+                    case '+':
+                    case '-':
+                        emitter.rex(false, src, dst);
+                        emitter.byte(op == '+' ? 0x01 : 0x29);   // add/sub dst, src
+                        emitter.modrmReg(src, dst);
+                        break;
+                    case '*':
+                        emitter.rex(false, dst, src);
+                        emitter.byte(0x0F);
+                        emitter.byte(0xAF);     // imul dst, src
+                        emitter.modrmReg(dst, src);
+                        break;
+                    default:
+                        emitter.rex(false, Emitter::RAX, dst);
+                        emitter.byte(0x8B);     // mov eax, dst
+                        emitter.modrmReg(Emitter::RAX, dst);
+                        emitter.byte(0x99);     // cdq
+                        emitter.rex(false, 0, src);
+                        emitter.byte(0xF7);     // idiv src
+                        emitter.modrmReg(7, src);
+                        emitter.rex(false, Emitter::RAX, dst);
+                        emitter.byte(0x89);     // mov dst, eax
+                        emitter.modrmReg(Emitter::RAX, dst);
+                        break;
+                    }
+                }
+                else {
+                    const std::uint8_t opcode = op == '+' ? 0x58 : op == '-' ? 0x5C : op == '*' ? 0x59 : 0x5E;
+                    sse(0xF2, opcode, dst, src);    // addsd/subsd/mulsd/divsd dst, src
+                    emitter.modrmReg(dst, src);
+                }
+                break;
+            }
+            }
+        }
+
+        // store the result and return 0
+        const auto result = reg(0);
+        const auto resultBase = isInt ? Emitter::RBP : Emitter::RDX;
+        if constexpr (isInt) {
+            emitter.rex(false, result, resultBase);
+            emitter.byte(0x89);     // mov [rbp], r32
+        }
+        else {
+            sse(0xF2, 0x11, result, resultBase);    // movsd [rdx], xmm0
+        }
+        emitter.modrmMem(result, resultBase, 0);
+        emitter.byte(0x31);     // xor eax, eax
+        emitter.modrmReg(Emitter::RAX, Emitter::RAX);
+
+        const auto exit = emitter.size();
+        if constexpr (isInt) {
+            for (auto r = 15; r >= 12; r--) {
+                emitter.byte(0x41);     // pop r15..r12
+                emitter.byte(static_cast<std::uint8_t>(0x58 + (r & 7)));
+            }
+            emitter.byte(0x5D);         // pop rbp
+            emitter.byte(0x5B);         // pop rbx
+        }
+        emitter.byte(0xC3);             // ret
+
+        // error sites return their index + 1
+        for (std::size_t i = 0; i < errorJumps.size(); i++) {
+            emitter.patch(errorJumps[i], emitter.size());
+            emitter.byte(0xB8);         // mov eax, imm32
+            emitter.imm32(static_cast<std::uint32_t>(i + 1));
+            emitter.patch(emitter.jump(0xE9), exit);
+        }
+
+        // map writable pages, copy the code and only then make them executable
+        const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        const auto size = (emitter.size() + pageSize - 1) / pageSize * pageSize;
+        void* const memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return;
+        }
+        std::memcpy(memory, emitter.data(), emitter.size());
+        if (::mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            ::munmap(memory, size);
+            return;
+        }
+
+        m_memory = memory;
+        m_mappedSize = size;
+        m_function = reinterpret_cast<Function>(memory);
+#endif
+    }
+
+    template<typename T>
+    ErrorCode JitExpression<T>::run(const T* variables, T& result, std::size_t& offset) const noexcept
+    {
+        if (variables == nullptr && m_program.variableCount() != 0) {
+            offset = 0;
+            return ErrorCode::UnknownVariable;
+        }
+
+        T temps[MAX_TEMPS];
+        const auto status = m_function(variables, temps, &result);
+        if (status != 0) {
+            offset = m_errorOffsets[static_cast<std::size_t>(status - 1)];
+            return ErrorCode::DivisionByZero;
+        }
+        return ErrorCode::None;
+    }
+
+    template<typename T>
+    T JitExpression<T>::evaluate() const
+    {
+        return evaluate(nullptr);
+    }
+
+    template<typename T>
+    T JitExpression<T>::evaluate(const T* variables) const
+    {
+        if (m_function == nullptr) {
+            return m_program.evaluate(variables);
+        }
+
+        T result{};
+        std::size_t offset = 0;
+        const auto code = run(variables, result, offset);
+        if (code != ErrorCode::None) {
+            throw ParserException{ code, offset };
+        }
+        return result;
+    }
+
+    template<typename T>
+    Result<T> JitExpression<T>::tryEvaluate() const noexcept
+    {
+        return tryEvaluate(nullptr);
+    }
+
+    template<typename T>
+    Result<T> JitExpression<T>::tryEvaluate(const T* variables) const noexcept
+    {
+        if (m_function == nullptr) {
+            return m_program.tryEvaluate(variables);
+        }
+
+        T result{};
+        std::size_t offset = 0;
+        const auto code = run(variables, result, offset);
+        if (code != ErrorCode::None) {
+            return Result<T>{ code, offset };
+        }
+        return Result<T>{ result };
+    }
+}
+
+#endif
@@ -0,0 +1,94 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Evaluation of many independent expressions on a thread pool.
+
+#ifndef ARITHMETIC_PARSER_PARALLEL_EVALUATION
+#define ARITHMETIC_PARSER_PARALLEL_EVALUATION
+
+#include <stdexcept>
+
+#include "ArithmeticParser.h"
+#include "ThreadPool.h"
+
+#if defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+
+namespace Parser
+{
+    namespace detail
+    {
+        // expressions per task, small enough for stealing to even out long and short lines
+        // and large enough that queueing costs nothing next to parsing
+        inline std::size_t evaluationChunk(const std::size_t count, const std::size_t threads) noexcept
+        {
+            constexpr std::size_t const minChunk = 64;
+            constexpr std::size_t const maxChunk = 16384;
+            const auto chunk = count / (threads * 16 + 1);
+            return (std::min)((std::max)(chunk, minChunk), maxChunk);
+        }
+    }
+
+    /*
+    *	Evaluates count independent expressions with the workers of pool and the calling thread.
+    *	results[i] is the result of expressions[i], errors are reported there as by tryEvaluate.
+    *	Each thread parses with its own parser, so nothing is shared between expressions.
+    *	The expressions are only read, they must stay valid until the function returns.
+    *	This is the entry point in C++17, the other overloads only forward to it.
+    */
+    template<typename T>
+    void evaluateAll(const std::string_view* expressions, const std::size_t count, Result<T>* results, ThreadPool& pool)
+    {
+        pool.parallelFor(count, detail::evaluationChunk(count, pool.size()),
+            [expressions, results](const std::size_t first, const std::size_t last) {
+                thread_local ArithmeticParser<T> parser;
+                for (auto i = first; i < last; i++) {
+                    results[i] = parser.tryEvaluate(expressions[i]);
+                }
+            });
+    }
+
+    // results is resized to the number of expressions
+    template<typename T>
+    void evaluateAll(const std::vector<std::string_view>& expressions, std::vector<Result<T>>& results, ThreadPool& pool)
+    {
+        results.resize(expressions.size());
+        evaluateAll(expressions.data(), expressions.size(), results.data(), pool);
+    }
+
+#if defined(__cpp_lib_span)
+    // results must hold at least as many elements as expressions, otherwise std::invalid_argument is thrown. C++20 only
+    template<typename T>
+    void evaluateAll(const std::span<const std::string_view> expressions, const std::span<Result<T>> results, ThreadPool& pool)
+    {
+        if (results.size() < expressions.size()) {
+            throw std::invalid_argument{ "evaluateAll: results is smaller than expressions" };
+        }
+        evaluateAll(expressions.data(), expressions.size(), results.data(), pool);
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,470 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Evaluation of files with one expression per line.
+//  The input is memory mapped one window at a time and the lines are parsed in place,
+//  so memory use depends on the window size and not on the size of the file.
+
+#ifndef ARITHMETIC_PARSER_STREAM_EVALUATION
+#define ARITHMETIC_PARSER_STREAM_EVALUATION
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <system_error>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#include "ArithmeticParser.h"
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Parser
+{
+    namespace detail
+    {
+        // read-only file which is mapped into memory one view at a time
+        class MappedFile
+        {
+        public:
+            // throws std::system_error if the file cannot be opened
+            explicit MappedFile(const char* path);
+            ~MappedFile();
+            // non-copyable class
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            std::uint64_t size() const noexcept
+            {
+                return m_size;
+            }
+
+            // maps [offset, offset + length) in place of the previous view, throws std::system_error
+            std::string_view map(std::uint64_t offset, std::size_t length);
+
+        private:
+            void unmap() noexcept;
+
+#if defined(_WIN32)
+            HANDLE m_file{ INVALID_HANDLE_VALUE };
+            HANDLE m_mapping{};
+#else
+            int m_fd{ -1 };
+#endif
+            void* m_view{};
+            std::size_t m_viewSize{};
+            std::uint64_t m_size{};
+        };
+
+#if defined(_WIN32)
+        inline std::system_error lastSystemError(const char* what)
+        {
+            return std::system_error{ static_cast<int>(GetLastError()), std::system_category(), what };
+        }
+
+        inline MappedFile::MappedFile(const char* path)
+        {
+            m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE) {
+                throw lastSystemError(path);
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size)) {
+                const auto error = lastSystemError(path);
+                CloseHandle(m_file);
+                throw error;
+            }
+            m_size = static_cast<std::uint64_t>(size.QuadPart);
+            // an empty file cannot be mapped, and there is nothing to map
+            if (m_size != 0) {
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping == nullptr) {
+                    const auto error = lastSystemError(path);
+                    CloseHandle(m_file);
+                    throw error;
+                }
+            }
+        }
+
+        inline MappedFile::~MappedFile()
+        {
+            unmap();
+            if (m_mapping != nullptr) {
+                CloseHandle(m_mapping);
+            }
+            CloseHandle(m_file);
+        }
+
+        inline std::string_view MappedFile::map(const std::uint64_t offset, const std::size_t length)
+        {
+            unmap();
+            if (length == 0) {
+                return {};
+            }
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            const auto skip = static_cast<std::size_t>(offset % info.dwAllocationGranularity);
+            const auto start = offset - skip;
+            m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, static_cast<DWORD>(start >> 32),
+                static_cast<DWORD>(start & 0xFFFFFFFFu), skip + length);
+            if (m_view == nullptr) {
+                throw lastSystemError("MapViewOfFile");
+            }
+            m_viewSize = skip + length;
+            return std::string_view{ static_cast<const char*>(m_view) + skip, length };
+        }
+
+        inline void MappedFile::unmap() noexcept
+        {
+            if (m_view != nullptr) {
+                UnmapViewOfFile(m_view);
+                m_view = nullptr;
+            }
+        }
+#else
+        inline MappedFile::MappedFile(const char* path)
+        {
+            m_fd = ::open(path, O_RDONLY);
+            if (m_fd == -1) {
+                throw std::system_error{ errno, std::generic_category(), path };
+            }
+            struct stat info;
+            if (::fstat(m_fd, &info) == -1) {
+                const auto error = errno;
+                ::close(m_fd);
+                throw std::system_error{ error, std::generic_category(), path };
+            }
+            m_size = static_cast<std::uint64_t>(info.st_size);
+        }
+
+        inline MappedFile::~MappedFile()
+        {
+            unmap();
+            ::close(m_fd);
+        }
+
+        inline std::string_view MappedFile::map(const std::uint64_t offset, const std::size_t length)
+        {
+            unmap();
+            if (length == 0) {
+                return {};
+            }
+            const auto page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+            const auto skip = static_cast<std::size_t>(offset % page);
+            auto view = ::mmap(nullptr, skip + length, PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(offset - skip));
+            if (view == MAP_FAILED) {
+                throw std::system_error{ errno, std::generic_category(), "mmap" };
+            }
+            // the view is read once from front to back
+            (void)::madvise(view, skip + length, MADV_SEQUENTIAL);
+            m_view = view;
+            m_viewSize = skip + length;
+            return std::string_view{ static_cast<const char*>(view) + skip, length };
+        }
+
+        inline void MappedFile::unmap() noexcept
+        {
+            if (m_view != nullptr) {
+                ::munmap(m_view, m_viewSize);
+                m_view = nullptr;
+            }
+        }
+#endif
+
+        // output file which is closed on destruction, unless it is stdout
+        struct OutputFile
+        {
+            explicit OutputFile(const char* path) :
+                file{ std::string_view{ path } == "-" ? stdout : std::fopen(path, "wb") }
+            {
+                if (file == nullptr) {
+                    throw std::system_error{ errno, std::generic_category(), path };
+                }
+            }
+
+            ~OutputFile()
+            {
+                if (file != stdout) {
+                    std::fclose(file);
+                }
+            }
+
+            OutputFile(const OutputFile&) = delete;
+            OutputFile& operator=(const OutputFile&) = delete;
+
+            std::FILE* file;
+        };
+    }
+
+    // counters of a StreamEvaluator, summed over all evaluated text
+    struct StreamStatistics
+    {
+        std::uint64_t lines;
+        std::uint64_t errors;
+        std::uint64_t bytes;    // input bytes, line breaks included
+    };
+
+    /*
+    *	Evaluates text with one expression per line and writes one line per expression:
+    *	the value, or "error at <offset>: <message>" if the expression is malformed.
+    *	A trailing '\r' is ignored, so files with Windows line breaks work as well.
+    *	The text is split on line breaks into chunks which the workers of the pool evaluate
+    *	in parallel, each into its own output buffer. The buffers are written in input order,
+    *	so the output lines match the input lines. Lines are parsed where they are, without copies.
+    *	Files are mapped one window at a time, a window grows for a longer line up to maxLineLength.
+    *	A line longer than that is skipped and reported as "error at <maxLineLength>: line too long".
+    */
+    template<typename T>
+    class StreamEvaluator
+    {
+    public:
+        INLINE static constexpr std::size_t const DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024;
+
+        // windowSize bounds the mapped part of the input and, with it, the output buffers.
+        // the window only grows for lines up to maxLineLength, 0 keeps lines to the window.
+        explicit StreamEvaluator(ThreadPool& pool, std::size_t windowSize = DEFAULT_WINDOW_SIZE,
+            std::size_t maxLineLength = 0);
+
+        /*
+        *	Evaluates all lines of text and passes the output to output(std::string_view) in order,
+        *	in pieces of whole lines. A last line without line break is evaluated as well.
+        */
+        template<typename Output>
+        void evaluate(std::string_view text, Output&& output);
+
+        /*
+        *	Evaluates the lines of the input file and writes the results to the output file,
+        *	"-" writes to stdout. Throws std::system_error if a file cannot be read or written.
+        */
+        void evaluateFile(const char* inputPath, const char* outputPath);
+        void evaluateFile(const char* inputPath, std::FILE* output);
+
+        NODISCARD StreamStatistics statistics() const noexcept
+        {
+            return m_statistics;
+        }
+
+    private:
+        struct Chunk
+        {
+            std::string_view text;
+            std::string output;
+            std::uint64_t lines;
+            std::uint64_t errors;
+        };
+
+        static void evaluateChunk(Chunk& chunk);
+        static void appendValue(std::string& output, T value);
+        // offset after the line break which ends the line containing offset, or the file size
+        std::uint64_t skipLine(detail::MappedFile& input, std::uint64_t offset) const;
+
+        ThreadPool& m_pool;
+        std::size_t m_windowSize;
+        std::size_t m_maxLineLength;
+        std::vector<Chunk> m_chunks;    // kept between calls so that the output buffers are reused
+        StreamStatistics m_statistics{};
+    };
+
+    template<typename T>
+    StreamEvaluator<T>::StreamEvaluator(ThreadPool& pool, const std::size_t windowSize, const std::size_t maxLineLength) :
+        m_pool{ pool },
+        m_windowSize{ windowSize == 0 ? DEFAULT_WINDOW_SIZE : windowSize },
+        m_maxLineLength{ maxLineLength == 0 ? m_windowSize - 1 : maxLineLength }
+    {
+    }
+
+    template<typename T>
+    template<typename Output>
+    void StreamEvaluator<T>::evaluate(const std::string_view text, Output&& output)
+    {
+        // several chunks per worker, so that stealing evens out chunks with long lines
+        constexpr std::size_t const minChunkSize = 64 * 1024;
+        const auto chunkSize = (std::max)(text.size() / (m_pool.size() * 8), minChunkSize);
+
+        std::size_t count = 0;
+        for (std::size_t first = 0; first < text.size(); count++) {
+            auto last = text.size();
+            if (text.size() - first > chunkSize) {
+                const auto lineBreak = text.find('\n', first + chunkSize);
+                last = lineBreak == std::string_view::npos ? text.size() : lineBreak + 1;
+            }
+            if (count == m_chunks.size()) {
+                m_chunks.emplace_back();
+            }
+            m_chunks[count].text = text.substr(first, last - first);
+            first = last;
+        }
+
+        m_pool.parallelFor(count, 1, [this](const std::size_t first, const std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                evaluateChunk(m_chunks[i]);
+            }
+        });
+
+        for (std::size_t i = 0; i < count; i++) {
+            output(std::string_view{ m_chunks[i].output });
+            m_statistics.lines += m_chunks[i].lines;
+            m_statistics.errors += m_chunks[i].errors;
+        }
+        m_statistics.bytes += text.size();
+    }
+
+    template<typename T>
+    void StreamEvaluator<T>::evaluateFile(const char* inputPath, const char* outputPath)
+    {
+        detail::OutputFile output{ outputPath };
+        evaluateFile(inputPath, output.file);
+        if (std::fflush(output.file) != 0) {
+            throw std::system_error{ errno, std::generic_category(), outputPath };
+        }
+    }
+
+    template<typename T>
+    void StreamEvaluator<T>::evaluateFile(const char* inputPath, std::FILE* output)
+    {
+        detail::MappedFile input{ inputPath };
+        const auto write = [output](const std::string_view text) {
+            if (std::fwrite(text.data(), 1, text.size(), output) != text.size()) {
+                throw std::system_error{ errno, std::generic_category(), "fwrite" };
+            }
+        };
+
+        // a window which holds a line of maxLineLength bytes and its line break
+        const auto maxWindow = (std::max)(m_windowSize, m_maxLineLength + 1);
+        auto window = m_windowSize;
+        for (std::uint64_t offset = 0; offset < input.size();) {
+            const auto length = static_cast<std::size_t>((std::min)(static_cast<std::uint64_t>(window), input.size() - offset));
+            auto text = input.map(offset, length);
+            if (offset + length < input.size()) {
+                // the window ends inside a line, which is left to the next window
+                const auto lineBreak = text.rfind('\n');
+                if (lineBreak == std::string_view::npos) {
+                    if (window < maxWindow) {
+                        // a line longer than the window, map more of it
+                        window = window > maxWindow / 2 ? maxWindow : window * 2;
+                        continue;
+                    }
+                    // a line longer than maxLineLength is not mapped as a whole
+                    const auto next = skipLine(input, offset + length);
+                    write("error at " + std::to_string(m_maxLineLength) + ": line too long\n");
+                    m_statistics.lines++;
+                    m_statistics.errors++;
+                    m_statistics.bytes += next - offset;
+                    offset = next;
+                    window = m_windowSize;
+                    continue;
+                }
+                text = text.substr(0, lineBreak + 1);
+            }
+            evaluate(text, write);
+            offset += text.size();
+            window = m_windowSize;
+        }
+    }
+
+    template<typename T>
+    std::uint64_t StreamEvaluator<T>::skipLine(detail::MappedFile& input, std::uint64_t offset) const
+    {
+        while (offset < input.size()) {
+            const auto length = static_cast<std::size_t>((std::min)(static_cast<std::uint64_t>(m_windowSize), input.size() - offset));
+            const auto text = input.map(offset, length);
+            const auto lineBreak = text.find('\n');
+            if (lineBreak != std::string_view::npos) {
+                return offset + lineBreak + 1;
+            }
+            offset += length;
+        }
+        return offset;
+    }
+
+    template<typename T>
+    void StreamEvaluator<T>::evaluateChunk(Chunk& chunk)
+    {
+        thread_local ArithmeticParser<T> parser;
+        chunk.output.clear();
+        chunk.lines = 0;
+        chunk.errors = 0;
+
+        const auto text = chunk.text;
+        for (std::size_t first = 0; first < text.size();) {
+            auto last = text.find('\n', first);
+            const auto next = last == std::string_view::npos ? text.size() : last + 1;
+            last = last == std::string_view::npos ? text.size() : last;
+            if (last > first && text[last - 1] == '\r') {
+                --last;
+            }
+
+            const auto result = parser.tryEvaluate(text.substr(first, last - first));
+            if (result) {
+                appendValue(chunk.output, result.value());
+            }
+            else {
+                chunk.output += "error at ";
+                chunk.output += std::to_string(result.offset());
+                chunk.output += ": ";
+                chunk.output += result.message();
+                chunk.errors++;
+            }
+            chunk.output += '\n';
+            chunk.lines++;
+            first = next;
+        }
+    }
+
+    template<typename T>
+    void StreamEvaluator<T>::appendValue(std::string& output, const T value)
+    {
+        // shortest text which reads back as the same value
+        char buffer[64];
+#if defined(__cpp_lib_to_chars)
+        const auto converted = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        output.append(buffer, converted.ptr);
+#else
+        // no floating point to_chars, enough digits to read back as the same value
+        if constexpr (std::is_integral<T>::value) {
+            output += std::to_string(value);
+        }
+        else {
+            const auto length = std::snprintf(buffer, sizeof(buffer), "%.*Lg",
+                std::numeric_limits<T>::max_digits10, static_cast<long double>(value));
+            output.append(buffer, static_cast<std::size_t>(length));
+        }
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,268 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Work-stealing thread pool used by the parallel evaluation functions.
+
+#ifndef ARITHMETIC_PARSER_THREAD_POOL
+#define ARITHMETIC_PARSER_THREAD_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parser
+{
+    /*
+    *	Fixed set of worker threads, each with its own task queue.
+    *	A worker takes tasks from the front of its own queue and, when that is empty,
+    *	steals from the back of the other queues, so uneven tasks even out by themselves.
+    *	Tasks must not throw, an escaping exception terminates the program.
+    */
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // threads == 0 uses one thread per hardware thread
+        explicit ThreadPool(std::size_t threads = 0);
+        // waits for the queued tasks, then joins the workers
+        ~ThreadPool();
+        // non-copyable class
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // number of worker threads
+        std::size_t size() const noexcept
+        {
+            return m_size;
+        }
+
+        // queue a task, on the calling worker's own queue when called from a task
+        void submit(Task task);
+
+        /*
+        *	Calls task(first, last) for consecutive ranges covering [0, count), at most chunk
+        *	items each, and returns when all of them are done. The ranges start out spread
+        *	evenly over the workers, idle workers steal what is left of the busy ones.
+        *	The calling thread takes part, so this also works from inside a task.
+        */
+        template<typename Function>
+        void parallelFor(std::size_t count, std::size_t chunk, Function&& task);
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        // a task popped from the queue of index, or stolen from another one
+        bool tryRun(std::size_t index);
+        bool pop(std::size_t index, bool steal, Task& task);
+        void workerLoop(std::size_t index);
+        void push(std::size_t index, Task task);
+
+        // the pool and queue of the calling thread, if it is a worker
+        struct WorkerIdentity
+        {
+            const ThreadPool* pool;
+            std::size_t index;
+        };
+
+        static WorkerIdentity& identity() noexcept
+        {
+            thread_local WorkerIdentity worker{ nullptr, 0 };
+            return worker;
+        }
+
+        // index of the calling thread's queue, npos for threads outside this pool
+        std::size_t currentIndex() const noexcept
+        {
+            const auto& worker = identity();
+            return worker.pool == this ? worker.index : npos;
+        }
+
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        std::size_t m_size{};      // fixed before the workers start, m_threads grows while they run
+        std::unique_ptr<Queue[]> m_queues;
+        std::vector<std::thread> m_threads;
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wake;
+        std::atomic<std::size_t> m_pending{};   // queued tasks which nobody took yet
+        std::atomic<std::size_t> m_next{};      // round robin for tasks from outside the pool
+        bool m_stop{};
+    };
+
+    inline ThreadPool::ThreadPool(std::size_t threads)
+    {
+        if (threads == 0) {
+            threads = (std::max)(1u, std::thread::hardware_concurrency());
+        }
+        m_size = threads;
+        m_queues.reset(new Queue[threads]);
+        m_threads.reserve(threads);
+        for (std::size_t i = 0; i < threads; i++) {
+            m_threads.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    inline ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ m_sleepMutex };
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    inline void ThreadPool::submit(Task task)
+    {
+        auto index = currentIndex();
+        if (index == npos) {
+            index = m_next.fetch_add(1, std::memory_order_relaxed) % m_size;
+        }
+        push(index, std::move(task));
+    }
+
+    inline void ThreadPool::push(const std::size_t index, Task task)
+    {
+        {
+            // counted under the sleep lock so that a worker going to sleep cannot miss it,
+            // and before the push so that the count never drops below zero
+            std::lock_guard<std::mutex> lock{ m_sleepMutex };
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock{ m_queues[index].mutex };
+            m_queues[index].tasks.push_back(std::move(task));
+        }
+        m_wake.notify_one();
+    }
+
+    inline bool ThreadPool::pop(const std::size_t index, const bool steal, Task& task)
+    {
+        auto& queue = m_queues[index];
+        std::lock_guard<std::mutex> lock{ queue.mutex };
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        if (steal) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    inline bool ThreadPool::tryRun(const std::size_t index)
+    {
+        Task task;
+        auto found = index < m_size && pop(index, false, task);
+        // steal, starting at the next queue so that thieves spread out
+        const auto start = index < m_size ? index + 1 : m_next.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; !found && i < m_size; i++) {
+            const auto victim = (start + i) % m_size;
+            found = victim != index && pop(victim, true, task);
+        }
+        if (found) {
+            task();
+        }
+        return found;
+    }
+
+    inline void ThreadPool::workerLoop(const std::size_t index)
+    {
+        identity() = WorkerIdentity{ this, index };
+        for (;;) {
+            if (tryRun(index)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock{ m_sleepMutex };
+            m_wake.wait(lock, [this]() { return m_stop || m_pending.load(std::memory_order_relaxed) != 0; });
+            if (m_stop && m_pending.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+        }
+    }
+
+    template<typename Function>
+    void ThreadPool::parallelFor(const std::size_t count, std::size_t chunk, Function&& task)
+    {
+        if (count == 0) {
+            return;
+        }
+        chunk = chunk == 0 ? 1 : chunk;
+        const auto chunks = (count + chunk - 1) / chunk;
+
+        // completion of the ranges, shared by the tasks
+        struct Latch
+        {
+            std::atomic<std::size_t> remaining;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        const auto latch = std::make_shared<Latch>();
+        latch->remaining.store(chunks, std::memory_order_relaxed);
+
+        // worker w starts with the w-th contiguous block of ranges
+        const auto workers = m_size;
+        for (std::size_t w = 0; w < workers; w++) {
+            for (auto c = chunks * w / workers; c < chunks * (w + 1) / workers; c++) {
+                const auto first = c * chunk;
+                const auto last = (std::min)(count, first + chunk);
+                push(w, [latch, &task, first, last]() {
+                    task(first, last);
+                    if (latch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        std::lock_guard<std::mutex> lock{ latch->mutex };
+                        latch->done.notify_all();
+                    }
+                });
+            }
+        }
+
+        // help until nothing is left to take, then wait for the ranges still running
+        const auto index = currentIndex();
+        while (latch->remaining.load(std::memory_order_acquire) != 0) {
+            if (!tryRun(index)) {
+                std::unique_lock<std::mutex> lock{ latch->mutex };
+                latch->done.wait(lock, [&latch]() { return latch->remaining.load(std::memory_order_acquire) == 0; });
+            }
+        }
+    }
+}
+
+#endif
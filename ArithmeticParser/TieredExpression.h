@@ -0,0 +1,283 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+//  Tiered execution of compiled expressions.
+//  An expression starts out on the interpreter it was compiled for and is moved to a faster
+//  backend once it has been evaluated often enough, so only hot expressions pay for optimization.
+
+#ifndef ARITHMETIC_PARSER_TIERED_EXPRESSION
+#define ARITHMETIC_PARSER_TIERED_EXPRESSION
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "ArithmeticParser.h"
+#include "JitExpression.h"
+#include "ThreadPool.h"
+
+namespace Parser
+{
+    // backends a TieredExpression moves through, in order
+    enum class Tier : unsigned char
+    {
+        Interpreted,    // the program as it was compiled
+        Optimized,      // a copy of the program on the engine which ran it fastest
+        Native          // machine code of a JitExpression, int and double only
+    };
+
+    /*
+    *	Compiled expression which counts its evaluations and, when the count reaches the threshold,
+    *	queues the compilation of a faster backend on the pool. Evaluation goes on with the current
+    *	tier meanwhile and switches to the new one as soon as it is published, the calling thread
+    *	never waits for the compilation. Native code is used where JitExpression can generate it.
+    *	Otherwise the upgrade times every interpreter engine on the variables of the evaluation
+    *	which reached the threshold and moves to the fastest one, if it is clearly faster than
+    *	the engine the program was compiled for. Programs which nothing speeds up stay interpreted.
+    *	Evaluation costs one atomic increment until the upgrade is queued and one load after that.
+    *	Like CompiledExpression, an instance can be shared by any number of threads.
+    *	The pool must outlive the expression, an upgrade still queued when it is destroyed finishes on its own.
+    */
+    template<typename T>
+    class TieredExpression
+    {
+    public:
+        INLINE static constexpr std::uint64_t const DEFAULT_THRESHOLD = 1000;
+
+        // threshold is the number of evaluations before the upgrade is queued, 0 queues it at once
+        TieredExpression(CompiledExpression<T> program, ThreadPool& pool, std::uint64_t threshold = DEFAULT_THRESHOLD);
+
+        // same contract as the functions of CompiledExpression
+        NODISCARD T evaluate() const;
+        NODISCARD T evaluate(const T* variables) const;
+        NODISCARD Result<T> tryEvaluate() const noexcept;
+        NODISCARD Result<T> tryEvaluate(const T* variables) const noexcept;
+
+        // the backend evaluation currently runs on
+        NODISCARD Tier tier() const noexcept
+        {
+            return m_state->tier.load(std::memory_order_acquire);
+        }
+
+        // true once the upgrade has run, whether it changed the tier or not
+        NODISCARD bool settled() const noexcept
+        {
+            return m_state->settled.load(std::memory_order_acquire);
+        }
+
+        // evaluations counted so far, counting stops once the upgrade is queued
+        NODISCARD std::uint64_t invocations() const noexcept
+        {
+            return m_state->invocations.load(std::memory_order_relaxed);
+        }
+
+        // the interpreted program, also used for its variables
+        NODISCARD const CompiledExpression<T>& program() const noexcept
+        {
+            return m_state->program;
+        }
+
+    private:
+        INLINE static constexpr bool const HAS_JIT = std::is_same<T, int>::value || std::is_same<T, double>::value;
+        // the native backend, a placeholder which is never created for the types JitExpression does not support
+        using Native = std::conditional_t<HAS_JIT, JitExpression<T>, CompiledExpression<T>>;
+
+        // shared with the queued upgrade, which may outlive the expression
+        struct State
+        {
+            explicit State(CompiledExpression<T> compiled) :
+                program{ std::move(compiled) }
+            {
+            }
+
+            CompiledExpression<T> program;
+            std::unique_ptr<CompiledExpression<T>> optimized;
+            std::unique_ptr<Native> native;
+            std::vector<T> sample;	// variables of the evaluation which reached the threshold
+            std::atomic<Tier> tier{ Tier::Interpreted };	// published after the backend it names
+            std::atomic<std::uint64_t> invocations{};
+            std::atomic<bool> settled{};
+        };
+
+        // count an evaluation of the interpreted program, queue the upgrade on reaching the threshold
+        void count(const T* variables) const;
+        // runs on the pool: promote and mark the state as settled
+        static void upgrade(State& state) noexcept;
+        // compile the faster backend and publish it, throws std::bad_alloc
+        static void promote(State& state);
+        // shortest time of a few rounds of evaluations of program
+        static std::chrono::steady_clock::duration measure(const CompiledExpression<T>& program, const T* variables);
+
+        std::shared_ptr<State> m_state;
+        ThreadPool& m_pool;
+        std::uint64_t m_threshold;
+    };
+
+    template<typename T>
+    TieredExpression<T>::TieredExpression(CompiledExpression<T> program, ThreadPool& pool, const std::uint64_t threshold) :
+        m_state{ std::make_shared<State>(std::move(program)) },
+        m_pool{ pool },
+        m_threshold{ threshold }
+    {
+        if (m_threshold == 0) {
+            m_pool.submit([state = m_state] { upgrade(*state); });
+        }
+    }
+
+    template<typename T>
+    T TieredExpression<T>::evaluate() const
+    {
+        return evaluate(nullptr);
+    }
+
+    template<typename T>
+    T TieredExpression<T>::evaluate(const T* variables) const
+    {
+        switch (tier()) {
+        case Tier::Native:
+            return m_state->native->evaluate(variables);
+        case Tier::Optimized:
+            return m_state->optimized->evaluate(variables);
+        default:
+            count(variables);
+            return m_state->program.evaluate(variables);
+        }
+    }
+
+    template<typename T>
+    Result<T> TieredExpression<T>::tryEvaluate() const noexcept
+    {
+        return tryEvaluate(nullptr);
+    }
+
+    template<typename T>
+    Result<T> TieredExpression<T>::tryEvaluate(const T* variables) const noexcept
+    {
+        switch (tier()) {
+        case Tier::Native:
+            return m_state->native->tryEvaluate(variables);
+        case Tier::Optimized:
+            return m_state->optimized->tryEvaluate(variables);
+        default:
+            try {
+                count(variables);
+            }
+            catch (const std::bad_alloc&) {
+                // the upgrade could not be queued, the expression stays interpreted
+            }
+            return m_state->program.tryEvaluate(variables);
+        }
+    }
+
+    template<typename T>
+    void TieredExpression<T>::count(const T* variables) const
+    {
+        // a plain load once the upgrade is queued, expressions which stay interpreted do not keep counting
+        if (m_state->invocations.load(std::memory_order_relaxed) >= m_threshold) {
+            return;
+        }
+        // exactly one evaluation sees the count reach the threshold
+        if (m_state->invocations.fetch_add(1, std::memory_order_relaxed) + 1 == m_threshold) {
+            if (variables != nullptr) {
+                m_state->sample.assign(variables, variables + m_state->program.variableCount());
+            }
+            m_pool.submit([state = m_state] { upgrade(*state); });
+        }
+    }
+
+    template<typename T>
+    void TieredExpression<T>::upgrade(State& state) noexcept
+    {
+        try {
+            promote(state);
+        }
+        catch (const std::bad_alloc&) {
+            // out of memory, the expression stays interpreted
+        }
+        state.settled.store(true, std::memory_order_release);
+    }
+
+    template<typename T>
+    void TieredExpression<T>::promote(State& state)
+    {
+        if constexpr (HAS_JIT) {
+            auto native = std::make_unique<Native>(state.program);
+            if (native->native()) {
+                state.native = std::move(native);
+                state.tier.store(Tier::Native, std::memory_order_release);
+                return;
+            }
+        }
+
+        // without a sample, e.g. when the upgrade was queued on construction, all variables are 1
+        if (state.sample.size() < state.program.variableCount()) {
+            state.sample.assign(state.program.variableCount(), T{ 1 });
+        }
+        // another engine has to be at least 10% faster, to stay clear of measurement noise
+        auto bestTime = measure(state.program, state.sample.data()) * 9 / 10;
+        std::unique_ptr<CompiledExpression<T>> best;
+        for (const auto engine : { Engine::Stack, Engine::Register, Engine::Closure }) {
+            if (engine == state.program.engine()) {
+                continue;
+            }
+            auto candidate = std::make_unique<CompiledExpression<T>>(state.program);
+            candidate->setEngine(engine);
+            // setEngine keeps the engine when the new one cannot run the program
+            if (candidate->engine() != engine) {
+                continue;
+            }
+            const auto time = measure(*candidate, state.sample.data());
+            if (time < bestTime) {
+                bestTime = time;
+                best = std::move(candidate);
+            }
+        }
+        if (best) {
+            state.optimized = std::move(best);
+            state.tier.store(Tier::Optimized, std::memory_order_release);
+        }
+    }
+
+    template<typename T>
+    std::chrono::steady_clock::duration TieredExpression<T>::measure(const CompiledExpression<T>& program, const T* variables)
+    {
+        constexpr int const rounds = 5;
+        constexpr int const evaluations = 256;
+        EvaluationContext<T> context;
+        (void)program.tryEvaluate(variables, context);  // sizes the context
+        auto shortest = std::chrono::steady_clock::duration::max();
+        for (int round = 0; round < rounds; round++) {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < evaluations; i++) {
+                (void)program.tryEvaluate(variables, context);
+            }
+            shortest = (std::min)(shortest, std::chrono::steady_clock::now() - start);
+        }
+        return shortest;
+    }
+}
+
+#endif
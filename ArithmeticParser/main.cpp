@@ -24,19 +24,12 @@
 //
 
 #include <iostream>
-#include <chrono>
 
 #include "ArithmeticParser.h"
 
-#define BENCHMARK_TEST  1
-
-namespace {
-	constexpr auto const MAX_ITER = 100000;
-}
-
 #define TEST_PARSER(str)                                                        \
 try {                                                                           \
-     std::cout << Parser::ArithmeticParserInt{str}.parseAndEvaluate() << "\n"; \
+     std::cout << parser.parseAndEvaluate(str) << "\n";                        \
 }                                                                               \
 catch (const Parser::ParserException& ex) {                                     \
      std::cout << "Exception thrown!: " << ex.getErrorMsg() << "\n";            \
@@ -44,6 +37,9 @@ catch (const Parser::ParserException& ex) {
 
 int main()
 {
+    // a single parser is reused for all expressions, even after errors
+    Parser::ArithmeticParserInt parser;
+
     TEST_PARSER("(4 + 5 * (7 - 3)) - 2");
     TEST_PARSER("4+5+7/2");
     TEST_PARSER("10 + 1");
@@ -57,28 +53,6 @@ int main()
     TEST_PARSER("5 /2 + 4 / 0");
 	TEST_PARSER("     ");   //nothing to parse
 
-#if BENCHMARK_TEST
-
-    auto sysClockNow = std::chrono::steady_clock::now();
-    
-    for (int i = 0; i < MAX_ITER; i++) {
-        try {
-            Parser::ArithmeticParserInt parser{ "5 + 4 * 3 / 2" };
-            (void)parser.parseAndEvaluate();
-        }
-        catch (...) {
-            // do not print anything, just a dummy test :)
-        }
-    }
-
-    auto sysClockEnd = std::chrono::steady_clock::now();
-
-    /* Getting number of milliseconds as a double. */
-    const std::chrono::duration<double, std::milli> ms_double = sysClockEnd - sysClockNow;
-
-    std::cout << "Benchmark test result: " << ms_double.count() << " ms\n";
-#endif
-
     return 0;
 }
 
@@ -0,0 +1,102 @@
+// MIT License
+
+// Copyright (c) 2022-2026 kadirlua
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// stream.cpp : evaluates a file with one expression per line and writes one result per line.
+//
+// usage: ArithmeticParserStream [--double] [--threads N] [--window MiB] [--max-line MiB] <input> <output>
+//   --double   evaluate as double instead of int
+//   --threads  number of worker threads, all hardware threads by default
+//   --window   size of the mapped part of the input in MiB, 64 by default
+//   --max-line longest line in MiB the window grows for, longer lines are reported as errors.
+//              by default lines must fit into the window
+// The output "-" writes to stdout. A summary is printed to stderr.
+
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include "StreamEvaluation.h"
+
+namespace {
+    int usage()
+    {
+        std::cerr << "usage: ArithmeticParserStream [--double] [--threads N] [--window MiB] [--max-line MiB] <input> <output>\n";
+        return EXIT_FAILURE;
+    }
+
+    template<typename T>
+    int run(const char* input, const char* output, const std::size_t threads, const std::size_t window,
+        const std::size_t maxLine)
+    {
+        Parser::ThreadPool pool{ threads };
+        Parser::StreamEvaluator<T> evaluator{ pool, window, maxLine };
+        try {
+            evaluator.evaluateFile(input, output);
+        }
+        catch (const std::system_error& ex) {
+            std::cerr << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        const auto stats = evaluator.statistics();
+        std::cerr << stats.lines << " lines, " << stats.errors << " errors, " << stats.bytes << " bytes\n";
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool floating = false;
+    std::size_t threads = 0;
+    std::size_t window = Parser::StreamEvaluator<int>::DEFAULT_WINDOW_SIZE;
+    std::size_t maxLine = 0;
+    const char* paths[2] = {};
+    std::size_t pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{ argv[i] };
+        if (arg == "--double") {
+            floating = true;
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--window" && i + 1 < argc) {
+            window = std::strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        }
+        else if (arg == "--max-line" && i + 1 < argc) {
+            // the window grows for lines up to this length, longer ones are reported as errors
+            maxLine = std::strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        }
+        else if (pathCount < 2 && (arg == "-" || arg.substr(0, 1) != "-")) {
+            paths[pathCount++] = argv[i];
+        }
+        else {
+            return usage();
+        }
+    }
+    if (pathCount != 2) {
+        return usage();
+    }
+
+    return floating ? run<double>(paths[0], paths[1], threads, window, maxLine) :
+        run<int>(paths[0], paths[1], threads, window, maxLine);
+}